@@ -0,0 +1,728 @@
+// Benchmarks for TwinArray<char> against std::vector<char>, std::string and
+// a classic gap buffer. Build and run with `./build.sh bench [filter]`; only
+// workloads whose name contains the filter are run.
+//
+// Every workload uses fixed seeds and sizes, so runs are comparable across
+// commits. Each one is timed a few times and the fastest run is reported as
+// ns per operation, together with the number of heap allocations it made.
+// The last few sections time TwinArray alone, comparing its own cursor
+// moves, layouts, scanning kernels, save paths and growth policies.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "twin_array.h"
+
+// Count every malloc-family call. TwinArray<char> allocates with realloc()
+// and the standard containers through operator new, which ends up in malloc(),
+// so this sees both.
+namespace {
+    std::size_t allocations = 0;
+}
+
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(std::size_t);
+void* __libc_calloc(std::size_t, std::size_t);
+void* __libc_realloc(void*, std::size_t);
+void __libc_free(void*);
+
+void* malloc(std::size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, std::size_t size) {
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) { __libc_free(ptr); }
+}
+#endif
+
+namespace {
+    // Read path into the buffer returned by alloc(file size). Returns the size.
+    template <typename Alloc>
+    std::size_t read_file(const char* path, Alloc&& alloc) {
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open");
+        }
+        const std::size_t len = ::lseek(fd, 0, SEEK_END);
+        char* out = alloc(len);
+        const ssize_t got = ::pread(fd, out, len, 0);
+        ::close(fd);
+        if (got != static_cast<ssize_t>(len)) {
+            throw std::system_error(errno, std::generic_category(), "pread");
+        }
+        return len;
+    }
+
+    void write_all(const int fd, const char* data, const std::size_t len) {
+        if (::write(fd, data, len) != static_cast<ssize_t>(len)) {
+            throw std::system_error(errno, std::generic_category(), "write");
+        }
+    }
+}  // namespace
+
+// The textbook gap buffer: one block with the gap at the cursor, moved with
+// memmove and doubled when it closes
+class GapBuffer {
+   public:
+    void move_to(const std::size_t pos) {
+        if (pos < gap_start) {
+            const std::size_t n = gap_start - pos;
+            std::memmove(data.data() + gap_end - n, data.data() + pos, n);
+            gap_start -= n;
+            gap_end -= n;
+        } else if (pos > gap_start) {
+            const std::size_t n = pos - gap_start;
+            std::memmove(data.data() + gap_start, data.data() + gap_end, n);
+            gap_start += n;
+            gap_end += n;
+        }
+    }
+
+    void insert(const char* text, const std::size_t n) {
+        if (gap_end - gap_start < n) {
+            grow(n);
+        }
+        std::memcpy(data.data() + gap_start, text, n);
+        gap_start += n;
+    }
+
+    void erase_before(const std::size_t n) { gap_start -= std::min(n, gap_start); }
+
+    char pop() { return data[--gap_start]; }
+
+    [[nodiscard]] char at(const std::size_t idx) const {
+        return data[idx < gap_start ? idx : idx + gap_end - gap_start];
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return data.size() - (gap_end - gap_start); }
+    [[nodiscard]] std::size_t cursor() const noexcept { return gap_start; }
+
+    // The text before and after the gap
+    [[nodiscard]] std::string_view before() const noexcept { return {data.data(), gap_start}; }
+    [[nodiscard]] std::string_view after() const noexcept {
+        return {data.data() + gap_end, data.size() - gap_end};
+    }
+
+    // Read a whole file in, with the cursor at the end
+    void load(const char* path) {
+        const std::size_t len = read_file(path, [&](const std::size_t len) {
+            data.resize(len + len / 8 + 64);
+            return data.data();
+        });
+        gap_start = len;
+        gap_end = data.size();
+    }
+
+    void save(const int fd) const {
+        write_all(fd, data.data(), gap_start);
+        write_all(fd, data.data() + gap_end, data.size() - gap_end);
+    }
+
+   private:
+    void grow(const std::size_t n) {
+        const std::size_t tail = data.size() - gap_end;
+        const std::size_t new_size = std::max(data.size() * 2, size() + n + 64);
+        data.resize(new_size);
+        std::memmove(data.data() + new_size - tail, data.data() + gap_end, tail);
+        gap_end = new_size - tail;
+    }
+
+    std::vector<char> data;
+    std::size_t gap_start = 0;
+    std::size_t gap_end = 0;
+};
+
+// Every contender behind the same interface: a sequence with one cursor,
+// usually of chars
+template <typename T, TwinLayout Layout>
+struct TwinEditor {
+    TwinArray<T, Layout> buf;
+
+    void move_to(const std::size_t pos) { buf.move_to(pos); }
+    void left() { buf.move_left(); }
+    void right() { buf.move_right(); }
+    void type(T val) { buf.push(std::move(val)); }
+    void paste(const std::string_view text) { buf.insert(text); }
+    void backspace() { buf.erase_before(1); }
+    T pop() { return *buf.pop(); }
+    [[nodiscard]] T at(const std::size_t idx) const { return buf.at(idx); }
+    [[nodiscard]] std::size_t size() const { return buf.size(); }
+
+    [[nodiscard]] std::size_t line_number() const { return buf.curr_line_index(); }
+    [[nodiscard]] std::string current_line() const { return buf.get_current_line(); }
+    [[nodiscard]] std::size_t find(const std::string_view needle) const {
+        return buf.find(needle);
+    }
+
+    void load(const char* path) { buf = TwinArray<T, Layout>::from_file(path); }
+    void save(const int fd) const { buf.write_to(fd); }
+};
+
+// std::vector and std::string, with the cursor kept as an index
+template <typename Container>
+struct ContainerEditor {
+    using T = Container::value_type;
+
+    Container text;
+    std::size_t cursor = 0;
+
+    void move_to(const std::size_t pos) { cursor = pos; }
+    void left() { cursor -= cursor > 0; }
+    void right() { cursor += cursor < text.size(); }
+    void type(T val) { text.insert(text.begin() + cursor++, std::move(val)); }
+    void paste(const std::string_view str) {
+        text.insert(text.begin() + cursor, str.begin(), str.end());
+        cursor += str.size();
+    }
+    void backspace() {
+        if (cursor > 0) {
+            text.erase(text.begin() + --cursor);
+        }
+    }
+    T pop() {
+        T val = std::move(text[--cursor]);
+        text.erase(text.begin() + cursor);
+        return val;
+    }
+    [[nodiscard]] T at(const std::size_t idx) const { return text.at(idx); }
+    [[nodiscard]] std::size_t size() const { return text.size(); }
+
+    // The char helpers, done the way callers would without them
+    [[nodiscard]] std::size_t line_number() const {
+        return std::count(text.begin(), text.begin() + cursor, '\n') + 1;
+    }
+    [[nodiscard]] std::string current_line() const {
+        const std::string_view view(text.data(), text.size());
+        const std::size_t prev = view.substr(0, cursor).rfind('\n');
+        const std::size_t start = prev == view.npos ? 0 : prev + 1;
+        return std::string(view.substr(start, view.find('\n', cursor) - start));
+    }
+    [[nodiscard]] std::size_t find(const std::string_view needle) const {
+        return std::string_view(text.data(), text.size()).find(needle);
+    }
+
+    void load(const char* path) {
+        cursor = read_file(path, [&](const std::size_t len) {
+            text.resize(len);
+            return text.data();
+        });
+    }
+    void save(const int fd) const { write_all(fd, text.data(), text.size()); }
+};
+
+struct GapEditor {
+    GapBuffer buf;
+
+    void move_to(const std::size_t pos) { buf.move_to(pos); }
+    void left() {
+        if (buf.cursor() > 0) {
+            buf.move_to(buf.cursor() - 1);
+        }
+    }
+    void right() {
+        if (buf.cursor() < buf.size()) {
+            buf.move_to(buf.cursor() + 1);
+        }
+    }
+    void type(const char c) { buf.insert(&c, 1); }
+    void paste(const std::string_view text) { buf.insert(text.data(), text.size()); }
+    void backspace() { buf.erase_before(1); }
+    char pop() { return buf.pop(); }
+    [[nodiscard]] char at(const std::size_t idx) const { return buf.at(idx); }
+    [[nodiscard]] std::size_t size() const { return buf.size(); }
+
+    [[nodiscard]] std::size_t line_number() const {
+        return std::ranges::count(buf.before(), '\n') + 1;
+    }
+    [[nodiscard]] std::string current_line() const {
+        const std::string_view before = buf.before();
+        const std::string_view after = buf.after();
+        const std::size_t start = before.rfind('\n');
+        std::string line(before.substr(start == before.npos ? 0 : start + 1));
+        line.append(after.substr(0, after.find('\n')));
+        return line;
+    }
+    // A match may span the gap, so search by moving it out of the way
+    [[nodiscard]] std::size_t find(const std::string_view needle) {
+        const std::size_t cursor = buf.cursor();
+        buf.move_to(buf.size());
+        const std::size_t pos = buf.before().find(needle);
+        buf.move_to(cursor);
+        return pos;
+    }
+
+    void load(const char* path) { buf.load(path); }
+    void save(const int fd) const { buf.save(fd); }
+};
+
+namespace {
+    constexpr std::size_t doc_size = 1 << 16;
+    constexpr std::size_t file_size = 64 << 20;
+    constexpr int runs = 3;
+
+    // Keeps results alive so the optimiser cannot drop the work
+    volatile std::size_t sink;
+
+    std::string sample_text(const std::size_t len) {
+        std::mt19937 rng(1);
+        std::string text(len, ' ');
+        for (auto& c : text) {
+            c = rng() % 16 == 0 ? '\n' : static_cast<char>('a' + rng() % 26);
+        }
+        return text;
+    }
+
+    // Typing in the middle of a document, with a backspace every few keys
+    std::size_t typing(auto& ed) {
+        constexpr std::size_t keys = 1 << 16;
+        ed.move_to(ed.size() / 2);
+        for (std::size_t i = 0; i < keys; i++) {
+            if (i % 8 == 7) {
+                ed.backspace();
+            } else {
+                ed.type(static_cast<char>('a' + i % 26));
+            }
+        }
+        return keys;
+    }
+
+    // Walking the cursor across the whole document and back a step at a
+    // time, typing a character every 64 steps
+    std::size_t cursor_sweep(auto& ed) {
+        const std::size_t len = ed.size();
+        ed.move_to(0);
+        for (std::size_t i = 0; i < len; i++) {
+            ed.right();
+            if (i % 64 == 0) {
+                ed.type('x');
+            }
+        }
+        const std::size_t back = ed.size();
+        for (std::size_t i = 0; i < back; i++) {
+            ed.left();
+        }
+        return len + back;
+    }
+
+    // Popping half the document from its middle, one char at a time
+    std::size_t pop(auto& ed) {
+        const std::size_t pops = ed.size() / 2;
+        ed.move_to(ed.size() * 3 / 4);
+        std::size_t sum = 0;
+        for (std::size_t i = 0; i < pops; i++) {
+            sum += ed.pop();
+        }
+        sink = sum;
+        return pops;
+    }
+
+    // Asking for the cursor's line number and text at random positions, with
+    // a search for a word every 16 jumps
+    std::size_t char_helpers(auto& ed) {
+        constexpr std::size_t jumps = 1 << 12;
+        std::mt19937 rng(5);
+        std::size_t sum = 0;
+        for (std::size_t i = 0; i < jumps; i++) {
+            ed.move_to(rng() % (ed.size() + 1));
+            sum += ed.line_number() + ed.current_line().size();
+            if (i % 16 == 0) {
+                sum += ed.find("zqj");
+            }
+        }
+        sink = sum;
+        return jumps;
+    }
+
+    // Reading characters at random positions
+    std::size_t random_access(auto& ed) {
+        constexpr std::size_t reads = 1 << 20;
+        std::mt19937 rng(2);
+        ed.move_to(ed.size() / 3);
+        std::size_t sum = 0;
+        for (std::size_t i = 0; i < reads; i++) {
+            sum += ed.at(rng() % ed.size());
+        }
+        sink = sum;
+        return reads;
+    }
+
+    // Pasting a 4 KiB block at random places
+    std::size_t paste(auto& ed) {
+        constexpr std::size_t pastes = 256;
+        const std::string block = sample_text(4096);
+        std::mt19937 rng(3);
+        for (std::size_t i = 0; i < pastes; i++) {
+            ed.move_to(rng() % (ed.size() + 1));
+            ed.paste(block);
+        }
+        return pastes;
+    }
+
+    // A large file on disk for the load and save workloads, removed on exit
+    struct BigFile {
+        BigFile() {
+            char name[] = "/tmp/twin_bench_XXXXXX";
+            const int fd = ::mkstemp(name);
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), "mkstemp");
+            }
+            const std::string text = sample_text(file_size);
+            write_all(fd, text.data(), text.size());
+            ::close(fd);
+            path = name;
+        }
+        ~BigFile() { ::unlink(path.c_str()); }
+
+        std::string path;
+    };
+
+    const char* big_file() {
+        static const BigFile file;
+        return file.path.c_str();
+    }
+
+    // Loading and saving are measured per byte
+    std::size_t load(auto& ed) {
+        ed.load(big_file());
+        return ed.size();
+    }
+
+    // Editing a sequence of heap-allocated tokens: stepping the cursor a few
+    // places either way, then inserting or deleting a token
+    std::size_t token_edits(auto& ed) {
+        constexpr std::size_t edits = 1 << 14;
+        std::mt19937 rng(4);
+        for (std::size_t i = 0; i < edits; i++) {
+            const int steps = static_cast<int>(rng() % 33) - 16;
+            for (int j = 0; j < std::abs(steps); j++) {
+                steps < 0 ? ed.left() : ed.right();
+            }
+            if (i % 4 == 3) {
+                ed.backspace();
+            } else {
+                ed.type(std::string(40, static_cast<char>('a' + i % 26)));
+            }
+        }
+        return edits;
+    }
+
+    std::size_t save(auto& ed) {
+        std::FILE* out = std::tmpfile();
+        ed.save(fileno(out));
+        std::fclose(out);
+        return ed.size();
+    }
+
+    struct Result {
+        double ns_per_op;
+        std::size_t allocs;
+    };
+
+    // What each run starts from
+    enum class Start { empty, document, big_file };
+
+    // Fastest of `runs` runs, each on a fresh editor prepared by setup(ed)
+    template <typename Editor>
+    Result measure(auto&& setup, auto&& workload) {
+        Result best = {1e300, 0};
+        for (int run = 0; run < runs; run++) {
+            Editor ed;
+            setup(ed);
+
+            const std::size_t allocs_before = allocations;
+            const auto begin = std::chrono::steady_clock::now();
+            const std::size_t ops = workload(ed);
+            const auto elapsed = std::chrono::steady_clock::now() - begin;
+            const std::size_t allocs = allocations - allocs_before;
+
+            const double ns = std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+            if (ns < best.ns_per_op) {
+                best = {ns, allocs};
+            }
+        }
+        return best;
+    }
+
+    template <typename Editor>
+    void report(const char* name, auto&& setup, auto&& workload) {
+        const Result r = measure<Editor>(setup, workload);
+        std::cout << "  " << std::left << std::setw(28) << name << std::right << std::setw(12)
+                  << std::fixed << std::setprecision(2) << r.ns_per_op << " ns/op"
+                  << std::setw(10) << r.allocs << " allocs\n";
+    }
+
+    std::string_view filter;
+
+    bool wanted(const std::string_view name) {
+        if (name.find(filter) == std::string_view::npos) {
+            return false;
+        }
+        std::cout << name << "\n";
+        return true;
+    }
+
+    // Text workloads, on every kind of char container
+    void run(const std::string_view name, const Start start, auto&& workload) {
+        if (!wanted(name)) {
+            return;
+        }
+        const std::string doc = sample_text(doc_size);
+        auto setup = [&](auto& ed) {
+            if (start == Start::document) {
+                ed.paste(doc);
+            } else if (start == Start::big_file) {
+                ed.load(big_file());
+            }
+        };
+        report<TwinEditor<char, TwinLayout::twin>>("TwinArray", setup, workload);
+        report<TwinEditor<char, TwinLayout::gap>>("TwinArray (gap)", setup, workload);
+        report<ContainerEditor<std::vector<char>>>("std::vector<char>", setup, workload);
+        report<ContainerEditor<std::string>>("std::string", setup, workload);
+        report<GapEditor>("gap buffer", setup, workload);
+    }
+
+    // Workloads on std::string elements, starting with the cursor in the
+    // middle of 16K tokens
+    void run_tokens(const std::string_view name, auto&& workload) {
+        if (!wanted(name)) {
+            return;
+        }
+        auto setup = [](auto& ed) {
+            for (int i = 0; i < 1 << 14; i++) {
+                ed.type(std::string(40, 'x'));
+            }
+            ed.move_to(ed.size() / 2);
+        };
+        using twin = TwinEditor<std::string, TwinLayout::twin>;
+        using gap = TwinEditor<std::string, TwinLayout::gap>;
+        report<twin>("TwinArray<std::string>", setup, workload);
+        report<gap>("TwinArray<std::string> (gap)", setup, workload);
+        report<ContainerEditor<std::vector<std::string>>>("std::vector<std::string>", setup,
+            workload);
+    }
+
+    // TwinArray on its own: how its design choices compare with each other
+
+    template <typename Fn>
+    double elapsed_us(Fn&& fn) {
+        const auto begin = std::chrono::steady_clock::now();
+        fn();
+        const auto elapsed = std::chrono::steady_clock::now() - begin;
+        return std::chrono::duration<double, std::micro>(elapsed).count();
+    }
+
+    void row(const std::string_view label, const double value, const char* unit) {
+        std::cout << "  " << std::left << std::setw(32) << label << std::right << std::setw(12)
+                  << std::fixed << std::setprecision(2) << value << " " << unit << "\n";
+    }
+
+    // Stepping the cursor one char at a time against a single move_to()
+    void cursor_jump() {
+        constexpr std::size_t len = 1 << 22;
+        auto buf = TwinArray<char>(std::string(len, 'x'));
+
+        for (std::size_t dist = 16; dist <= len; dist *= 16) {
+            const double stepped = elapsed_us([&] {
+                for (std::size_t i = 0; i < dist; i++) {
+                    buf.move_left();
+                }
+                for (std::size_t i = 0; i < dist; i++) {
+                    buf.move_right();
+                }
+            });
+            const double jumped = elapsed_us([&] {
+                buf.move_to(len - dist);
+                buf.move_to(len);
+            });
+
+            const std::string label = "distance " + std::to_string(dist);
+            row(label + ", move_left/right", stepped, "us");
+            row(label + ", move_to", jumped, "us");
+        }
+    }
+
+    // Tracks the bytes an allocator has handed out and not taken back
+    class CountingResource : public std::pmr::memory_resource {
+       public:
+        std::size_t in_use = 0;
+
+       private:
+        void* do_allocate(std::size_t bytes, std::size_t align) override {
+            in_use += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, align);
+        }
+
+        void do_deallocate(void* ptr, std::size_t bytes, std::size_t align) override {
+            in_use -= bytes;
+            std::pmr::new_delete_resource()->deallocate(ptr, bytes, align);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    // Memory held by each layout after loading 1 MiB and typing 512 KiB more
+    void memory_usage() {
+        constexpr std::size_t len = 1 << 20;
+        const std::string text(len, 'x');
+
+        const auto measure = [&]<TwinLayout Layout>() {
+            CountingResource res;
+            auto buf = pmr::TwinArray<char, Layout>(text, &res);
+            for (std::size_t i = 0; i < len / 2; i++) {
+                buf.push('y');
+            }
+            return static_cast<double>(res.in_use) / 1024;
+        };
+
+        row("twin layout", measure.template operator()<TwinLayout::twin>(), "KiB");
+        row("gap layout", measure.template operator()<TwinLayout::gap>(), "KiB");
+    }
+
+    // The byte scanning kernels against the standard algorithms, over 64 MiB
+    void newline_scanning() {
+        namespace detail = twin_array_detail;
+        constexpr std::size_t len = 1 << 26;
+
+        std::string text(len, 'x');
+        for (std::size_t i = 0; i < len; i += 80) {
+            text[i] = '\n';
+        }
+        text[len - 1] = 'x';
+
+        const auto time = [&](const char* name, auto&& fn) {
+            row(name, elapsed_us([&] { sink = fn(); }), "us");
+        };
+        time("std::count", [&] { return std::count(text.begin(), text.end(), '\n'); });
+        time("count_scalar", [&] { return detail::count_scalar(text.data(), len, '\n'); });
+        time("count dispatched", [&] {
+            return detail::byte_kernels().count(text.data(), len, '\n');
+        });
+        time("string_view::find_last_of", [&] {
+            return std::string_view(text).find_last_of('\n');
+        });
+        time("rfind_scalar", [&] {
+            return detail::rfind_scalar(text.data(), len, 'y') == nullptr;
+        });
+        time("rfind dispatched", [&] {
+            return detail::byte_kernels().rfind(text.data(), len, 'y') == nullptr;
+        });
+        time("load TwinArray<char>", [&] { return TwinArray<char>(text).line_count(); });
+    }
+
+    // Ways of writing 100 MiB with the cursor in the middle to a file
+    void save_methods() {
+        constexpr std::size_t len = 100 << 20;
+        auto buf = TwinArray<char>(std::string(len, 'x'));
+        buf.move_to(len / 2);
+        auto gap = TwinArray<char, TwinLayout::gap>(std::string(len, 'x'));
+        gap.move_to(len / 2);
+
+        const auto time = [&](const char* name, auto&& fn) {
+            std::FILE* file = std::tmpfile();
+            const double us = elapsed_us([&] {
+                fn(file);
+                std::fflush(file);
+            });
+            std::fclose(file);
+            row(name, us / 1000, "ms");
+        };
+        time("per-char copy + fwrite", [&](std::FILE* file) {
+            std::string s;
+            for (const char c : buf) {
+                s.push_back(c);
+            }
+            std::fwrite(s.data(), 1, s.size(), file);
+        });
+        time("to_str + fwrite", [&](std::FILE* file) {
+            const std::string s = buf.to_str();
+            std::fwrite(s.data(), 1, s.size(), file);
+        });
+        time("write_to(fd)", [&](std::FILE* file) { buf.write_to(fileno(file)); });
+        time("write_to(fd), gap layout", [&](std::FILE* file) { gap.write_to(fileno(file)); });
+    }
+
+    // Latency of single pushes while the buffer grows to 16 MiB, per growth
+    // policy and allocation path
+    void keystroke_latency() {
+        constexpr std::size_t keystrokes = 1 << 24;
+
+        const auto measure = [&](const std::string& name, const TwinGrowth policy, auto buf) {
+            buf.set_growth_policy(policy);
+            std::vector<std::chrono::nanoseconds> times(keystrokes);
+            for (auto& t : times) {
+                const auto begin = std::chrono::steady_clock::now();
+                buf.push('x');
+                t = std::chrono::steady_clock::now() - begin;
+            }
+
+            std::sort(times.begin(), times.end());
+            row(name + ", p50", times[keystrokes / 2].count(), "ns");
+            row(name + ", p99", times[keystrokes * 99 / 100].count(), "ns");
+            row(name + ", p99.99", times[keystrokes * 9999 / 10000].count(), "ns");
+            row(name + ", max", times.back().count(), "ns");
+        };
+
+        measure("realloc, doubling", {}, TwinArray<char>());
+        measure("realloc, 1 MiB steps", {.max_step = 1 << 20}, TwinArray<char>());
+        measure("allocator, doubling", {}, pmr::TwinArray<char>());
+        measure("allocator, 1 MiB steps", {.max_step = 1 << 20}, pmr::TwinArray<char>());
+    }
+}  // namespace
+
+int main(int argc, char** argv) {
+    filter = argc > 1 ? argv[1] : "";
+
+    run("typing", Start::document, [](auto& ed) { return typing(ed); });
+    run("cursor sweep", Start::document, [](auto& ed) { return cursor_sweep(ed); });
+    run("random access", Start::document, [](auto& ed) { return random_access(ed); });
+    run("paste", Start::document, [](auto& ed) { return paste(ed); });
+    run("pop", Start::document, [](auto& ed) { return pop(ed); });
+    run("char helpers", Start::document, [](auto& ed) { return char_helpers(ed); });
+    run("load", Start::empty, [](auto& ed) { return load(ed); });
+    run("save", Start::big_file, [](auto& ed) { return save(ed); });
+    run_tokens("token edits", [](auto& ed) { return token_edits(ed); });
+
+    if (wanted("cursor jump")) {
+        cursor_jump();
+    }
+    if (wanted("memory usage")) {
+        memory_usage();
+    }
+    if (wanted("newline scanning")) {
+        newline_scanning();
+    }
+    if (wanted("save methods")) {
+        save_methods();
+    }
+    if (wanted("keystroke latency")) {
+        keystroke_latency();
+    }
+}
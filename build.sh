@@ -1,9 +1,22 @@
 #!/bin/bash
 
-compile_cmd="clang++ -std=c++20 -Wall -Wextra -g main.cpp -o test"
+# ./build.sh [test filter]     build and run the unit tests, then the TwinStats
+#                              tests, which need their own build
+# ./build.sh bench [filter]    build and run the benchmarks, optimised
+if [ "$1" = "bench" ]; then
+    shift
+    compile_cmd="clang++ -std=c++20 -Wall -Wextra -O2 -DNDEBUG bench.cpp -o bench"
+    run_cmds="./bench"
+else
+    compile_cmd="clang++ -std=c++20 -Wall -Wextra -g main.cpp -o test &&
+        clang++ -std=c++20 -Wall -Wextra -g stats.cpp -o stats_test"
+    run_cmds="./test ./stats_test"
+fi
 
 if eval "$compile_cmd"; then
-    ./test ${1:+$1}
+    for run_cmd in $run_cmds; do
+        $run_cmd ${1:+"$1"}
+    done
 else
     echo "Failed with return code $?"
 fi
@@ -1,11 +1,56 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <sstream>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "twin_array.h"
 #include "ut.hpp"
 
 namespace ut = boost::ut;
 
+// Tracks how many instances are alive, to check TwinArray constructs and
+// destroys exactly the elements it holds
+struct Counted {
+    static inline int alive = 0;
+    int val;
+
+    Counted(int v = 0) : val(v) { alive++; }
+    Counted(const Counted& other) : val(other.val) { alive++; }
+    Counted& operator=(const Counted&) = default;
+    ~Counted() { alive--; }
+};
+
+// Counts copies, to check elements are moved wherever they can be
+struct Token {
+    static inline int copies = 0;
+    std::string text;
+
+    Token(std::string text) : text(std::move(text)) {}
+    Token(const Token& other) : text(other.text) { copies++; }
+    Token(Token&&) noexcept = default;
+    Token& operator=(const Token&) = default;
+    Token& operator=(Token&&) noexcept = default;
+};
+
+// Parameters for tests that run once per layout. The test reads the layout
+// back from the type it is given:
+//     "Name"_test = []<class Layout>() { TwinArray<int, Layout::value> buf; } | layouts;
+template <TwinLayout Layout>
+using LayoutParam = std::integral_constant<TwinLayout, Layout>;
+inline constexpr auto layouts =
+    std::tuple<LayoutParam<TwinLayout::twin>, LayoutParam<TwinLayout::gap>> {};
+
 ut::suite<"Constructors"> constructors = [] {
     using namespace ut;
 
@@ -87,6 +132,15 @@ ut::suite<"Modifiers"> modifiers = [] {
 
             expect(!(p.has_value()));
         };
+
+        should("Cursor at start") = [] {
+            TwinArray<int> buf = {1, 2};
+            buf.move_to(0);
+            auto p = buf.pop();
+
+            expect(!(p.has_value()));
+            expect(buf.size() == 2);
+        };
     };
 
     "Move Left"_test = [] {
@@ -129,6 +183,173 @@ ut::suite<"Modifiers"> modifiers = [] {
             expect(buf.peek() == 1);
         };
     };
+
+    "Insert"_test = [] {
+        should("Sized range") = [] {
+            TwinArray<int> buf = {1, 5};
+            buf.move_left();
+
+            std::vector<int> v = {2, 3, 4};
+            buf.insert(v);
+            expect(buf.size() == 5);
+            expect(buf.peek() == 4);
+            for (int i = 0; i < 5; i++) {
+                expect(buf.at(i) == i + 1) << buf.at(i);
+            }
+        };
+
+        should("Grows once") = [] {
+            auto buf = TwinArray<char, TwinLayout::gap>(4);
+            buf.insert(std::string_view("world"));
+            buf.move_to(0);
+            buf.insert(std::string(1000, '.'));
+
+            expect(buf.total_capacity() == 1005);
+            expect(buf.to_str() == std::string(1000, '.') + "world");
+        };
+
+        should("Unsized range") = [] {
+            TwinArray<int> buf = {0};
+            buf.insert(std::views::iota(1, 4) | std::views::filter([](int i) { return i != 2; }));
+            buf.insert({7, 8});
+
+            std::vector<int> out(buf.begin(), buf.end());
+            expect(out == std::vector<int> {0, 1, 3, 7, 8});
+        };
+
+        should("Non trivial type") = [] {
+            TwinArray<std::string> buf = {"a", "d"};
+            buf.move_left();
+            buf.insert(std::vector<std::string> {"b", "c"});
+
+            expect(buf.at(1) == "b");
+            expect(buf.at(3) == "d");
+        };
+    };
+
+    "Insert From Itself"_test = []<class Layout>() {
+        // Full, so each insert grows the storage the span points into
+        TwinArray<int, Layout::value> buf = {1, 2, 3, 4};
+        buf.move_to(2);
+        buf.shrink_to_fit();
+        expect(buf.total_capacity() == 4);
+        buf.insert(buf.lhs_span());
+        expect(std::ranges::equal(buf, std::vector {1, 2, 1, 2, 3, 4}));
+
+        buf.shrink_to_fit();
+        buf.insert(buf.rhs_span());
+        expect(std::ranges::equal(buf, std::vector {1, 2, 1, 2, 3, 4, 3, 4}));
+    } | layouts;
+
+    "Erase Before"_test = [] {
+        std::string s = "Hello world";
+        auto buf = TwinArray<char>(s);
+        buf.move_to(5);
+
+        expect(buf.erase_before(2) == 2u);
+        expect(buf.to_str() == "Hel world");
+        expect(buf.erase_before(10) == 3u);
+        expect(buf.to_str() == " world");
+        expect(buf.erase_before(1) == 0u);
+    };
+
+    "Erase After"_test = [] {
+        std::string s = "Hello world";
+        auto buf = TwinArray<char, TwinLayout::gap>(s);
+        buf.move_to(5);
+
+        expect(buf.erase_after(3) == 3u);
+        expect(buf.to_str() == "Hellorld");
+        expect(buf.erase_after(10) == 3u);
+        expect(buf.to_str() == "Hello");
+        expect(buf.erase_after(1) == 0u);
+        expect(buf.peek() == 'o');
+    };
+
+    "Move To"_test = [] {
+        should("Jump left") = [] {
+            TwinArray<int> buf = {1, 2, 3, 4, 5};
+            buf.move_to(1);
+
+            expect(buf.peek() == 1);
+            expect(buf.size() == 5);
+            for (int i = 0; i < 5; i++) {
+                expect(buf.at(i) == i + 1) << buf.at(i);
+            }
+        };
+
+        should("Jump right") = [] {
+            TwinArray<int> buf = {1, 2, 3, 4, 5};
+            buf.move_to(0);
+            buf.move_to(4);
+
+            expect(buf.peek() == 4);
+            for (int i = 0; i < 5; i++) {
+                expect(buf.at(i) == i + 1) << buf.at(i);
+            }
+        };
+
+        should("Match single steps") = [] {
+            std::string s(300, ' ');
+            for (std::size_t i = 0; i < s.size(); i++) {
+                s[i] = static_cast<char>('a' + i % 26);
+            }
+            auto stepped = TwinArray<char>(s);
+            auto jumped = TwinArray<char>(s);
+
+            for (int i = 0; i < 250; i++) {
+                stepped.move_left();
+            }
+            jumped.move_to(50);
+
+            expect(jumped.to_str() == s);
+            expect(jumped.peek() == stepped.peek());
+            expect(jumped.curr_char_index() == stepped.curr_char_index());
+        };
+
+        should("Out of range") = [] {
+            TwinArray<int> buf = {1, 2, 3};
+            expect(throws<std::out_of_range>([&] { buf.move_to(4); }));
+        };
+    };
+
+    "Move By"_test = [] {
+        TwinArray<int> buf = {1, 2, 3, 4, 5};
+        buf.move_by(-3);
+        expect(buf.peek() == 2);
+
+        buf.move_by(2);
+        expect(buf.peek() == 4);
+
+        buf.move_by(-10);
+        buf.move_by(1);
+        expect(buf.peek() == 1);
+
+        buf.move_by(10);
+        expect(buf.peek() == 5);
+        expect(buf.size() == 5);
+    };
+
+    "Emplace And Move"_test = []<class Layout>() {
+        Token::copies = 0;
+        auto buf = TwinArray<Token, Layout::value>(2);
+        expect(buf.emplace("one").text == "one");
+        buf.push(Token("two"));
+        buf.emplace(std::string(3, 'x'));
+        buf.move_to(0);
+        buf.move_to(3);
+        buf.move_left();
+        buf.move_right();
+        buf.resize(16);
+        expect(buf.pop()->text == "xxx");
+        expect(Token::copies == 0) << Token::copies;
+
+        // Arguments referring into the buffer survive it growing
+        buf.shrink_to_fit();
+        buf.push(buf.front());
+        expect(buf.back().text == "one");
+        expect(Token::copies == 1) << Token::copies;
+    } | layouts;
 };
 
 ut::suite<"Element Access"> element_access = [] {
@@ -154,6 +375,248 @@ ut::suite<"Element Access"> element_access = [] {
         TwinArray<int> buf = {1, 2, 3};
         expect(buf.peek() == 3);
     };
+
+    "Unchecked"_test = []<class Layout>() {
+        auto buf = TwinArray<std::string, Layout::value>({"a", "b", "c", "d"});
+        buf.move_to(1);
+
+        const auto& cbuf = buf;
+        expect(cbuf[0] == "a" && cbuf[1] == "b" && cbuf[3] == "d");
+        expect(&cbuf[2] == &buf[2]);
+        expect(cbuf.front() == "a" && cbuf.back() == "d");
+        expect(cbuf.before_cursor() == "a" && cbuf.after_cursor() == "b");
+
+        buf[1] += "!";
+        buf.front() = "A";
+        buf.back().push_back('?');
+        buf.after_cursor().insert(0, "<");
+        expect(std::ranges::equal(buf, std::vector<std::string> {"A", "<b!", "c", "d?"}));
+
+        using strings = std::vector<std::string>;
+        expect(std::ranges::equal(cbuf.lhs_span(), strings {"A"}));
+        expect(std::ranges::equal(cbuf.rhs_span(), strings {"<b!", "c", "d?"}));
+        for (auto& s : buf.rhs_span()) {
+            s = s.substr(0, 1);
+        }
+        buf.lhs_span()[0] = "a";
+        expect(std::ranges::equal(buf, std::vector<std::string> {"a", "<", "c", "d"}));
+    } | layouts;
+
+    "Mutable Access Stops Sharing"_test = [] {
+        auto buf = TwinArray<int> {1, 2, 3};
+        const auto snap = buf.snapshot();
+        buf[0] = 7;
+        buf.move_to(1);
+        buf.rhs_span()[0] = 8;
+        expect(snap.at(0) == 1 && snap.at(1) == 2);
+        expect(buf.at(0) == 7 && buf.at(1) == 8 && buf.at(2) == 3);
+    };
+};
+
+ut::suite<"Lifetime"> lifetime = [] {
+    using namespace ut;
+
+    "Only Live Elements Are Constructed"_test = [] {
+        should("Twin layout") = [] {
+            {
+                auto buf = TwinArray<Counted>(64);
+                expect(Counted::alive == 0) << Counted::alive;
+
+                for (int i = 0; i < 100; i++) {
+                    buf.push(Counted(i));
+                }
+                buf.move_to(30);
+                buf.move_left();
+                (void)buf.pop();
+                expect(Counted::alive == buf.size()) << Counted::alive;
+
+                auto copy = buf;
+                expect(Counted::alive == 2 * buf.size()) << Counted::alive;
+                expect(copy.at(50).val == 51);
+            }
+            expect(Counted::alive == 0) << Counted::alive;
+        };
+
+        should("Gap layout") = [] {
+            {
+                auto buf = TwinArray<Counted, TwinLayout::gap>(4);
+                for (int i = 0; i < 10; i++) {
+                    buf.push(Counted(i));
+                }
+                buf.move_to(3);
+                buf.move_right();
+                buf.push(Counted(42));
+                expect(Counted::alive == buf.size()) << Counted::alive;
+                expect(buf.at(4).val == 42);
+            }
+            expect(Counted::alive == 0) << Counted::alive;
+        };
+    };
+
+    "Strings"_test = [] {
+        auto buf = TwinArray<std::string>(2);
+        buf.push(std::string(40, 'a'));
+        buf.push(std::string(40, 'b'));
+        buf.push(std::string(40, 'c'));
+        buf.move_to(1);
+
+        expect(buf.at(2) == std::string(40, 'c'));
+        expect(buf.pop().value() == std::string(40, 'a'));
+    };
+};
+
+// memory_resource that counts what passes through it
+class CountingResource : public std::pmr::memory_resource {
+   public:
+    std::size_t in_use = 0;
+    std::size_t allocations = 0;
+
+   private:
+    void* do_allocate(std::size_t bytes, std::size_t align) override {
+        in_use += bytes;
+        allocations++;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t align) override {
+        in_use -= bytes;
+        std::pmr::new_delete_resource()->deallocate(ptr, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+ut::suite<"Allocators"> allocators = [] {
+    using namespace ut;
+
+    "Storage Comes From The Allocator"_test = [] {
+        CountingResource res;
+        {
+            auto buf = pmr::TwinArray<int>(8, &res);
+            expect(res.in_use == 2 * 8 * sizeof(int)) << res.in_use;
+
+            for (int i = 0; i < 20; i++) {
+                buf.push(i);
+            }
+            expect(res.in_use == 2 * 32 * sizeof(int)) << res.in_use;
+            expect(buf.get_allocator().resource() == &res);
+        }
+        expect(res.in_use == 0) << res.in_use;
+    };
+
+    "Elements Use The Allocator"_test = [] {
+        CountingResource res;
+        {
+            auto buf = pmr::TwinArray<std::pmr::string, TwinLayout::gap>(4, &res);
+            const std::pmr::string outside(64, 'a');
+            std::size_t before = res.allocations;
+            buf.push(outside);
+            expect(res.allocations == before + 1) << res.allocations;
+
+            // Moving the cursor moves elements rather than copying them
+            before = res.allocations;
+            buf.move_left();
+            buf.move_right();
+            expect(res.allocations == before) << res.allocations;
+        }
+        expect(res.in_use == 0) << res.in_use;
+    };
+
+    "Copy And Move"_test = [] {
+        CountingResource a;
+        CountingResource b;
+
+        pmr::TwinArray<int> src({1, 2, 3}, &a);
+        src.move_left();
+
+        // polymorphic_allocator does not propagate, copies use the default resource
+        pmr::TwinArray<int> copy = src;
+        expect(copy.get_allocator().resource() != &a);
+
+        pmr::TwinArray<int> dest(4, &b);
+        dest = std::move(src);
+        expect(dest.get_allocator().resource() == &b);
+        expect(dest.size() == 3);
+        expect(dest.at(2) == 3);
+        expect(dest.peek() == 2);
+
+        pmr::TwinArray<int> same(4, &b);
+        same = std::move(dest);
+        expect(same.at(0) == 1);
+        expect(a.in_use == 2 * src.total_capacity() * sizeof(int)) << a.in_use;
+    };
+
+    "Swap"_test = [] {
+        TwinArray<int> a = {1, 2};
+        TwinArray<int> b = {3, 4, 5};
+        swap(a, b);
+
+        expect(a.size() == 3);
+        expect(b.at(1) == 2);
+    };
+};
+
+ut::suite<"Iterators"> iterators = [] {
+    using namespace ut;
+
+    static_assert(std::random_access_iterator<TwinArray<int>::iterator>);
+    static_assert(std::random_access_iterator<TwinArray<int>::const_iterator>);
+    static_assert(std::ranges::random_access_range<TwinArray<int, TwinLayout::gap>>);
+
+    "Range For"_test = [] {
+        TwinArray<int> buf = {1, 2, 3, 4};
+        buf.move_left();
+        buf.move_left();
+
+        std::vector<int> out;
+        for (const auto& val : buf) {
+            out.push_back(val);
+        }
+        expect(out == std::vector<int> {1, 2, 3, 4});
+    };
+
+    "Algorithms"_test = [] {
+        TwinArray<int> buf = {4, 1, 3, 2};
+        buf.move_to(1);
+        std::ranges::sort(buf);
+
+        std::vector<int> out(buf.size());
+        std::copy(buf.cbegin(), buf.cend(), out.begin());
+        expect(out == std::vector<int> {1, 2, 3, 4});
+        expect(buf.peek() == 1);
+        expect(std::ranges::find(buf, 3) - buf.begin() == 2);
+    };
+
+    "Reverse"_test = [] {
+        TwinArray<int> buf = {1, 2, 3};
+        buf.move_left();
+
+        std::vector<int> out(buf.rbegin(), buf.rend());
+        expect(out == std::vector<int> {3, 2, 1});
+    };
+
+    "Segments"_test = [] {
+        should("Twin layout") = [] {
+            TwinArray<int> buf = {1, 2, 3, 4, 5};
+            buf.move_to(2);
+            auto [left, right] = buf.segments();
+
+            expect(std::vector<int>(left.begin(), left.end()) == std::vector<int> {1, 2});
+            expect(std::vector<int>(right.begin(), right.end()) == std::vector<int> {3, 4, 5});
+        };
+
+        should("Gap layout") = [] {
+            TwinArray<int, TwinLayout::gap> buf = {1, 2, 3, 4, 5};
+            buf.move_to(3);
+            const auto& cbuf = buf;
+            auto [left, right] = cbuf.segments();
+
+            expect(std::vector<int>(left.begin(), left.end()) == std::vector<int> {1, 2, 3});
+            expect(std::vector<int>(right.begin(), right.end()) == std::vector<int> {4, 5});
+        };
+    };
 };
 
 ut::suite<"Capacity"> capacity = [] {
@@ -238,6 +701,70 @@ ut::suite<"Capacity"> capacity = [] {
         buf.move_left();
         expect(buf.total_capacity() == 4);
         expect(buf.size() == 3);
+
+        expect(throws<std::length_error>([&] { buf.resize(2); }));
+    };
+
+    "Reserve"_test = [] {
+        should("Twin layout") = [] {
+            TwinArray<int> buf = {1, 2, 3};
+            buf.move_left();
+            buf.reserve(100);
+
+            expect(buf.total_capacity() == 100);
+            expect(buf.at(2) == 3);
+            expect(buf.peek() == 2);
+
+            buf.reserve(10);
+            expect(buf.total_capacity() == 100);
+        };
+
+        should("Gap layout") = [] {
+            TwinArray<char, TwinLayout::gap> buf(std::string_view("abcdef"));
+            buf.move_to(2);
+            buf.reserve(1000);
+
+            expect(buf.to_str() == "abcdef");
+            expect(buf.peek() == 'b');
+        };
+
+        should("Custom allocator") = [] {
+            pmr::TwinArray<std::pmr::string, TwinLayout::gap> buf = {"a", "b", "c"};
+            buf.move_left();
+            buf.reserve(50);
+
+            expect(buf.total_capacity() == 50);
+            expect(buf.at(2) == "c");
+            expect(buf.peek() == "b");
+        };
+    };
+
+    "Shrink To Fit"_test = [] {
+        TwinArray<char, TwinLayout::gap> buf(std::string_view("hello"));
+        buf.move_to(3);
+        buf.shrink_to_fit();
+
+        expect(buf.total_capacity() == 5);
+        expect(buf.to_str() == "hello");
+
+        buf.push('!');
+        expect(buf.to_str() == "hel!lo");
+    };
+
+    "Growth Policy"_test = [] {
+        auto buf = TwinArray<int>(100);
+        buf.set_growth_policy({.factor = 1.5, .max_step = 20});
+
+        for (int i = 0; i < 101; i++) {
+            buf.push(i);
+        }
+        expect(buf.total_capacity() == 120);
+
+        auto copy = buf;
+        expect(copy.growth_policy().max_step == 20);
+
+        expect(throws<std::invalid_argument>([&] { buf.set_growth_policy({.factor = 1.0}); }));
+        expect(throws<std::invalid_argument>([&] { buf.set_growth_policy({.max_step = 0}); }));
     };
 };
 
@@ -251,6 +778,135 @@ ut::suite<"Char only"> char_only = [] {
         expect(buf.to_str() == s);
     };
 
+    "Write To"_test = []<class Layout>() {
+        std::string s(200'000, '\0');
+        for (std::size_t i = 0; i < s.size(); i++) {
+            s[i] = static_cast<char>('a' + i % 26);
+        }
+
+        auto buf = TwinArray<char, Layout::value>(s);
+        buf.move_to(1234);
+        expect(buf.to_str() == s);
+
+        std::ostringstream os;
+        buf.write_to(os);
+        expect(os.str() == s);
+
+        std::FILE* file = std::tmpfile();
+        buf.write_to(fileno(file));
+        std::rewind(file);
+        std::string read(s.size() + 1, '\0');
+        read.resize(std::fread(read.data(), 1, read.size(), file));
+        std::fclose(file);
+        expect(read == s);
+    } | layouts;
+
+    "Write To Bad Descriptor"_test = [] {
+        const auto buf = TwinArray<char>(std::string_view("x"));
+        expect(throws<std::system_error>([&] { buf.write_to(-1); }));
+    };
+
+    "From File"_test = []<class Layout>() {
+        std::string s;
+        for (int i = 0; i < 20'000; i++) {
+            s += "line " + std::to_string(i) + "\n";
+        }
+
+        char path[] = "/tmp/twin_array_XXXXXX";
+        const int fd = mkstemp(path);
+        expect(fd >= 0);
+        expect(write(fd, s.data(), s.size()) == static_cast<ssize_t>(s.size()));
+        close(fd);
+
+        auto buf = TwinArray<char, Layout::value>::from_file(path);
+        std::remove(path);
+        expect(buf.to_str() == s);
+        expect(buf.size() == static_cast<int>(s.size()));
+        expect(buf.line_count() == 20'001u);
+        expect(buf.curr_line_index() == 20'001);
+
+        buf.move_to(5);
+        buf.push('!');
+        expect(buf.line(1) == "line !0");
+
+        expect(throws<std::system_error>([&] { (void)TwinArray<char>::from_file(path); }));
+    } | layouts;
+
+    "From Pipe"_test = [] {
+        // Pipes can't be mapped, so they go through the read() fallback
+        int pipe_fds[2];
+        expect(pipe(pipe_fds) == 0);
+        expect(write(pipe_fds[1], "a\nb", 3) == 3);
+        close(pipe_fds[1]);
+        const auto piped =
+            TwinArray<char>::from_file("/dev/fd/" + std::to_string(pipe_fds[0]));
+        close(pipe_fds[0]);
+        expect(piped.to_str() == "a\nb");
+        expect(piped.line_count() == 2u);
+    };
+
+    "Loader"_test = []<class Layout>() {
+        std::string s;
+        for (int i = 0; i < 2'000; i++) {
+            s += "row " + std::to_string(i) + (i % 3 == 0 ? "\n" : " ");
+        }
+
+        char path[] = "/tmp/twin_array_XXXXXX";
+        const int fd = mkstemp(path);
+        expect(write(fd, s.data(), s.size()) == static_cast<ssize_t>(s.size()));
+        lseek(fd, 0, SEEK_SET);
+        std::remove(path);
+
+        TwinArray<char, Layout::value> buf;
+        TwinLoader loader(fd, 100);
+        expect(loader.total() == s.size());
+
+        // Edit the loaded prefix between steps, away from the end
+        std::string expected = s;
+        std::size_t steps = 0;
+        while (loader.step(buf)) {
+            if (++steps % 10 == 0) {
+                const std::size_t pos = steps % buf.size();
+                buf.move_to(pos);
+                buf.push('\n');
+                expected.insert(pos, 1, '\n');
+            }
+            expect(static_cast<std::size_t>(buf.size()) == loader.loaded() + steps / 10);
+        }
+        close(fd);
+
+        expect(loader.done());
+        expect(loader.loaded() == s.size());
+        expect(buf.to_str() == expected);
+
+        const auto fresh = TwinArray<char, Layout::value>(expected);
+        expect(buf.line_count() == fresh.line_count());
+        for (std::size_t n = 1; n <= fresh.line_count(); n++) {
+            expect(buf.line_start(n) == fresh.line_start(n));
+        }
+    } | layouts;
+
+    "Loader Waits For Pipes"_test = [] {
+        // A non-blocking pipe with nothing ready doesn't end the load
+        int pipe_fds[2];
+        expect(pipe(pipe_fds) == 0);
+        fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+
+        TwinArray<char> buf;
+        TwinLoader loader(pipe_fds[0]);
+        expect(loader.step(buf));
+        expect(loader.total() == 0u);
+        expect(loader.loaded() == 0u);
+
+        expect(write(pipe_fds[1], "ab\ncd", 5) == 5);
+        close(pipe_fds[1]);
+        while (loader.step(buf)) {
+        }
+        close(pipe_fds[0]);
+        expect(buf.to_str() == "ab\ncd");
+        expect(buf.line_count() == 2u);
+    };
+
     "Get Current Line"_test = [] {
         std::string s = "Hello world\n";
         auto buf = TwinArray<char>(s);
@@ -304,4 +960,1196 @@ ut::suite<"Char only"> char_only = [] {
     };
 };
 
+ut::suite<"Gap Layout"> gap_layout = [] {
+    using namespace ut;
+    using GapArray = TwinArray<int, TwinLayout::gap>;
+
+    "Push And Pop"_test = [] {
+        auto buf = GapArray(2);
+        buf.push(1);
+        buf.push(2);
+        buf.push(3);
+
+        expect(buf.size() == 3);
+        expect(buf.total_capacity() == 4);
+        expect(buf.pop().value() == 3);
+        expect(buf.peek() == 2);
+    };
+
+    "Move Left And Right"_test = [] {
+        GapArray buf = {1, 2, 3, 4};
+        buf.move_left();
+        buf.move_left();
+        expect(buf.peek() == 2);
+
+        buf.push(9);
+        buf.move_right();
+        expect(buf.peek() == 3);
+
+        const std::vector<int> expected = {1, 2, 9, 3, 4};
+        for (std::size_t i = 0; i < expected.size(); i++) {
+            expect(buf.at(i) == expected[i]) << buf.at(i);
+        }
+    };
+
+    "Move When Full"_test = [] {
+        // With no gap left, the element crossing the cursor stays in place
+        auto buf = GapArray(4);
+        for (int i = 1; i <= 4; i++) {
+            buf.push(i);
+        }
+        expect(buf.total_capacity() == 4);
+
+        buf.move_left();
+        buf.move_left();
+        expect(buf.peek() == 2);
+        buf.move_right();
+        expect(buf.peek() == 3);
+        for (int i = 0; i < 4; i++) {
+            expect(buf.at(i) == i + 1) << buf.at(i);
+        }
+    };
+
+    "Move To"_test = [] {
+        GapArray buf = {1, 2, 3, 4, 5, 6};
+        buf.move_to(1);
+        expect(buf.peek() == 1);
+
+        buf.move_to(5);
+        expect(buf.peek() == 5);
+        for (int i = 0; i < 6; i++) {
+            expect(buf.at(i) == i + 1) << buf.at(i);
+        }
+    };
+
+    "Move To When Full"_test = [] {
+        // The span crossing the cursor is already in place, nothing is copied
+        GapArray buf = {1, 2, 3, 4, 5, 6};
+        buf.shrink_to_fit();
+        expect(buf.total_capacity() == 6);
+        buf.move_to(1);
+        expect(buf.peek() == 1);
+        buf.move_to(5);
+        expect(buf.peek() == 5);
+        for (int i = 0; i < 6; i++) {
+            expect(buf.at(i) == i + 1) << buf.at(i);
+        }
+
+        auto text = TwinArray<char, TwinLayout::gap>(std::string_view("a\nb\nc"));
+        text.shrink_to_fit();
+        text.move_to(1);
+        expect(text.curr_line_index() == 1);
+        text.move_to(4);
+        expect(text.curr_line_index() == 3);
+        expect(text.to_str() == "a\nb\nc");
+    };
+
+    "Resize Keeps Both Halves"_test = [] {
+        auto buf = GapArray(4);
+        buf.push(1);
+        buf.push(2);
+        buf.push(3);
+        buf.move_left();
+        buf.move_left();
+        buf.push(4);
+        buf.push(5);
+
+        expect(buf.total_capacity() == 8);
+        const std::vector<int> expected = {1, 4, 5, 2, 3};
+        for (std::size_t i = 0; i < expected.size(); i++) {
+            expect(buf.at(i) == expected[i]) << buf.at(i);
+        }
+    };
+
+    "Copy"_test = [] {
+        GapArray buf = {1, 2, 3};
+        buf.move_left();
+
+        GapArray copy = buf;
+        expect(copy.size() == 3);
+        expect(copy.at(2) == 3);
+        expect(copy.peek() == 2);
+    };
+
+    "To Str"_test = [] {
+        std::string s = "Hello world\n";
+        auto buf = TwinArray<char, TwinLayout::gap>(s);
+        buf.move_to(5);
+
+        expect(buf.to_str() == s);
+        expect(buf.get_current_char() == 'o');
+    };
+};
+
+ut::suite<"Small Buffer"> small_buffer = [] {
+    using namespace ut;
+
+    using SmallText = TwinArray<char, TwinLayout::gap, std::pmr::polymorphic_allocator<char>, 16>;
+
+    "Stays Inline"_test = [] {
+        CountingResource res;
+        auto buf = SmallText(std::string_view("hello"), &res);
+        buf.move_to(2);
+        for (const char c : std::string_view("0123456789a")) {
+            buf.push(c);
+        }
+
+        expect(buf.to_str() == "he0123456789allo");
+        expect(buf.total_capacity() == 16);
+        expect(res.allocations == 0u);
+
+        static_assert(sizeof(SmallTwinArray<char, 16>) < sizeof(TwinArray<char>) + 16 + 8);
+        expect(SmallTwinArray<char, 16>().total_capacity() == 16);
+        expect(TwinArray<char, TwinLayout::twin, std::allocator<char>, 4>().total_capacity() == 4);
+    };
+
+    "Spills On Growth"_test = []<class Layout>() {
+        CountingResource res;
+        TwinArray<char, Layout::value, std::pmr::polymorphic_allocator<char>, 4> buf(&res);
+        buf.push('a');
+        buf.push('b');
+        buf.push('c');
+        buf.move_left();
+        buf.push('\n');
+        buf.push('d');
+        buf.push('e');
+        expect(res.allocations > 0u);
+        expect(buf.to_str() == "ab\ndec");
+        expect(buf.peek() == 'e');
+        expect(buf.line_count() == 2u);
+
+        // Shrinking back under the inline capacity moves back inline
+        buf.erase_before(3);
+        buf.erase_after(1);
+        buf.shrink_to_fit();
+        expect(buf.to_str() == "ab");
+        expect(buf.total_capacity() == 4);
+
+        const std::size_t allocations = res.allocations;
+        buf.push('x');
+        buf.push('y');
+        expect(buf.to_str() == "abxy");
+        expect(res.allocations == allocations);
+    } | layouts;
+
+    "Copy Move And Swap"_test = [] {
+        using Small = SmallTwinArray<std::string, 2>;
+        const std::string long_str(100, 'x');
+
+        auto small = Small {"a", long_str};
+        small.move_left();
+        auto big = Small {"b", "c", "d", long_str};
+        big.move_to(1);
+
+        auto copy = small;
+        expect(std::ranges::equal(copy, small));
+
+        auto moved = std::move(copy);
+        expect(std::ranges::equal(moved, small));
+        expect(copy.empty());
+
+        swap(moved, big);
+        expect(std::ranges::equal(big, std::vector<std::string> {"a", long_str}));
+        expect(std::ranges::equal(moved, std::vector<std::string> {"b", "c", "d", long_str}));
+        expect(big.peek() == "a");
+        expect(moved.peek() == "b");
+
+        big = moved;
+        expect(std::ranges::equal(big, moved));
+        moved = Small {"e"};
+        expect(std::ranges::equal(moved, std::vector<std::string> {"e"}));
+    };
+};
+
+ut::suite<"Undo"> undo = [] {
+    using namespace ut;
+
+    auto type = [](auto& buf, std::string_view text) {
+        for (const char c : text) {
+            buf.push(c);
+        }
+    };
+
+    "Typing Is One Step"_test = [&] {
+        auto buf = TwinArray<char>();
+        expect(!buf.undo());
+        buf.enable_journal();
+        expect(!buf.can_undo());
+
+        type(buf, "hello");
+        expect(buf.undo());
+        expect(buf.to_str() == "");
+        expect(!buf.can_undo());
+
+        expect(buf.redo());
+        expect(buf.to_str() == "hello");
+        expect(buf.peek() == 'o');
+        expect(!buf.redo());
+    };
+
+    "Deletes Coalesce"_test = [&] {
+        auto buf = TwinArray<char>(std::string_view("hello\nworld"));
+        buf.enable_journal();
+
+        (void)buf.pop();
+        (void)buf.pop();
+        buf.erase_before(2);
+        expect(buf.to_str() == "hello\nw");
+        expect(buf.undo());
+        expect(buf.to_str() == "hello\nworld");
+        expect(buf.curr_char_index() == 5);
+        expect(!buf.can_undo());
+
+        buf.move_to(0);
+        buf.erase_after(1);
+        buf.erase_after(3);
+        expect(buf.to_str() == "o\nworld");
+        expect(buf.undo());
+        expect(buf.to_str() == "hello\nworld");
+        expect(buf.peek() == '\0');
+        expect(buf.line_count() == 2u);
+    };
+
+    "Backspace Eats Typing First"_test = [&] {
+        auto buf = TwinArray<char>(std::string_view("abc"));
+        buf.enable_journal();
+
+        type(buf, "de");
+        buf.erase_before(3);
+        expect(buf.to_str() == "ab");
+        expect(buf.undo());
+        expect(buf.to_str() == "abc");
+        expect(!buf.can_undo());
+
+        type(buf, "xy");
+        (void)buf.pop();
+        (void)buf.pop();
+        expect(!buf.can_undo());
+    };
+
+    "Separate Edits"_test = [&] {
+        auto buf = TwinArray<int> {1, 2, 3};
+        buf.enable_journal();
+
+        buf.push(4);
+        buf.move_to(0);
+        buf.push(0);
+        expect(std::ranges::equal(buf, std::vector {0, 1, 2, 3, 4}));
+
+        expect(buf.undo());
+        expect(std::ranges::equal(buf, std::vector {1, 2, 3, 4}));
+
+        // Editing after an undo drops what could have been redone
+        buf.push(9);
+        expect(!buf.can_redo());
+        expect(buf.undo());
+        expect(buf.undo());
+        expect(std::ranges::equal(buf, std::vector {1, 2, 3}));
+    };
+
+    "Transactions"_test = [&] {
+        auto buf = TwinArray<char>(std::string_view("middle"));
+        buf.enable_journal();
+
+        buf.begin_transaction();
+        type(buf, " end");
+        buf.begin_transaction();
+        buf.move_to(0);
+        type(buf, "start ");
+        buf.end_transaction();
+        buf.erase_after(3);
+        buf.end_transaction();
+        expect(buf.to_str() == "start dle end");
+        expect(throws<std::logic_error>([&] { buf.end_transaction(); }));
+
+        expect(buf.undo());
+        expect(buf.to_str() == "middle");
+        expect(!buf.can_undo());
+        expect(buf.redo());
+        expect(buf.to_str() == "start dle end");
+
+        buf.begin_transaction();
+        expect(throws<std::logic_error>([&] { buf.undo(); }));
+        buf.end_transaction();
+    };
+
+    "Replays To Every State"_test = []<class Layout>() {
+        std::mt19937 rng(7);
+        auto buf = TwinArray<char, Layout::value>(std::string_view("a\nb\nc"));
+        buf.enable_journal();
+        const std::string start = buf.to_str();
+
+        for (int i = 0; i < 2'000; i++) {
+            switch (rng() % 6) {
+                case 0:
+                    buf.move_to(rng() % (buf.size() + 1));
+                    break;
+                case 1:
+                    (void)buf.pop();
+                    break;
+                case 2:
+                    buf.erase_after(rng() % 3);
+                    break;
+                case 3:
+                    buf.insert(std::string_view("x\ny"));
+                    break;
+                default:
+                    buf.push(rng() % 4 == 0 ? '\n' : 'z');
+                    break;
+            }
+        }
+        const std::string end = buf.to_str();
+
+        while (buf.undo()) {
+        }
+        expect(buf.to_str() == start);
+        while (buf.redo()) {
+        }
+        expect(buf.to_str() == end);
+
+        const auto fresh = TwinArray<char, Layout::value>(end);
+        expect(buf.line_count() == fresh.line_count());
+    } | layouts;
+
+    "Copies Start Fresh"_test = [&] {
+        auto buf = TwinArray<char>();
+        buf.enable_journal();
+        type(buf, "abc");
+
+        auto copy = buf;
+        expect(!copy.journal_enabled());
+
+        auto moved = std::move(buf);
+        expect(moved.can_undo());
+
+        moved = copy;
+        expect(moved.journal_enabled());
+        expect(!moved.can_undo());
+
+        moved = std::move(copy);
+        expect(!moved.journal_enabled());
+    };
+
+    "Move Only Elements"_test = [] {
+        // Nothing is recorded for elements the history cannot copy
+        auto buf = TwinArray<std::unique_ptr<int>>(2);
+        buf.push(std::make_unique<int>(1));
+        buf.emplace(std::make_unique<int>(2));
+        buf.insert(std::views::iota(3, 5) | std::views::transform([](int i) {
+            return std::make_unique<int>(i);
+        }));
+        expect(buf.size() == 4);
+        expect(*buf.pop().value() == 4);
+        expect(buf.erase_before(1) == 1);
+        buf.move_left();
+        expect(buf.erase_after(1) == 1);
+
+        auto other = std::move(buf);
+        buf = std::move(other);
+        expect(buf.size() == 1);
+        expect(*buf.front() == 1);
+        expect(!buf.journal_enabled());
+    };
+};
+
+ut::suite<"Snapshots"> snapshots = [] {
+    using namespace ut;
+
+    "Unaffected By Edits"_test = []<class Layout>() {
+        auto buf = TwinArray<char, Layout::value>(std::string_view("hello world"));
+        buf.move_to(5);
+        const auto snap = buf.snapshot();
+
+        (void)buf.pop();
+        buf.push('O');
+        buf.move_to(0);
+        buf.insert(std::string_view("> "));
+        buf.erase_after(3);
+        buf.move_to(buf.size());
+        for (int i = 0; i < 100; i++) {
+            buf.push('!');
+        }
+
+        expect(buf.to_str() == "> lO world" + std::string(100, '!'));
+        expect(snap.to_str() == "hello world");
+        expect(snap.size() == 11u);
+        expect(snap.at(4) == 'o');
+        expect(snap.at(6) == 'w');
+        expect(throws<std::out_of_range>([&] { (void)snap.at(11); }));
+    } | layouts;
+
+    "Storage Is Shared"_test = [] {
+        CountingResource res;
+        std::string text(100'000, 'a');
+        auto buf = pmr::TwinArray<char, TwinLayout::gap>(text, &res);
+        buf.move_to(50'000);
+        const std::size_t allocations = res.allocations;
+
+        const auto snap = buf.snapshot();
+        const auto copy = snap;
+        buf.push('b');
+        buf.move_to(0);
+        buf.push('c');
+        (void)buf.pop();
+        expect(res.allocations == allocations);
+
+        text.insert(50'000, 1, 'b');
+        expect(buf.to_str() == text);
+        expect(copy.to_str() == std::string(100'000, 'a'));
+    };
+
+    "Matches Every Past State"_test = []<class Layout>() {
+        std::mt19937 rng(11);
+        auto buf = TwinArray<char, Layout::value>(std::string(20'000, '.'));
+        std::vector<std::pair<TwinSnapshot<char>, std::string>> taken;
+
+        for (int i = 0; i < 3'000; i++) {
+            switch (rng() % 8) {
+                case 0:
+                    buf.move_to(rng() % (buf.size() + 1));
+                    break;
+                case 1:
+                    buf.erase_before(rng() % 50);
+                    break;
+                case 2:
+                    buf.erase_after(rng() % 50);
+                    break;
+                case 3:
+                    buf.insert(std::string(rng() % 200, 'i'));
+                    break;
+                case 4:
+                    if (rng() % 20 == 0) {
+                        taken.emplace_back(buf.snapshot(), buf.to_str());
+                    }
+                    break;
+                default:
+                    buf.push(static_cast<char>('a' + rng() % 26));
+                    break;
+            }
+        }
+
+        for (const auto& [snap, expected] : taken) {
+            expect(snap.to_str() == expected);
+        }
+    } | layouts;
+
+    "Small Buffers Copy"_test = [] {
+        auto buf = SmallTwinArray<char, 16>(std::string_view("short"));
+        const auto snap = buf.snapshot();
+        buf.move_to(0);
+        buf.push('x');
+        expect(snap.to_str() == "short");
+        expect(buf.to_str() == "xshort");
+    };
+
+    "Mutable Access Stops Sharing"_test = [] {
+        auto buf = TwinArray<int> {1, 2, 3};
+        const auto snap = buf.snapshot();
+        *buf.begin() = 7;
+        expect(snap.at(0) == 1);
+        expect(buf.at(0) == 7);
+    };
+
+    "Read While Editing"_test = [] {
+        auto buf = TwinArray<char>(std::string(50'000, 'x'));
+        buf.move_to(25'000);
+        const auto snap = buf.snapshot();
+        const std::string expected = buf.to_str();
+
+        std::atomic<bool> stop = false;
+        std::atomic<int> mismatches = 0;
+        std::thread reader([&] {
+            while (!stop) {
+                if (snap.to_str() != expected) {
+                    mismatches++;
+                }
+            }
+        });
+
+        for (int i = 0; i < 20'000; i++) {
+            buf.move_by(i % 2 == 0 ? -3'000 : 2'000);
+            buf.push('y');
+        }
+        stop = true;
+        reader.join();
+
+        expect(mismatches == 0);
+        expect(snap.to_str() == expected);
+    };
+};
+
+ut::suite<"Concurrency"> concurrency = [] {
+    using namespace ut;
+
+    // A reader runs to completion while the writer is halfway through an
+    // edit that has already copied chunks aside. Were reads waiting for
+    // edits, the join would never return.
+    "Reads Do Not Wait For Edits"_test = [] {
+        const std::string initial(20'000, 'a');
+        auto shared = ConcurrentTwinArray<char>(TwinArray<char>(initial));
+
+        std::string seen;
+        shared.edit([&](auto& buf) {
+            buf.move_to(0);
+            buf.insert(std::string(10'000, 'b'));
+            std::thread reader([&] { seen = shared.read().to_str(); });
+            reader.join();
+            buf.erase_after(5'000);
+        });
+
+        expect(seen == initial);
+        expect(shared.read().to_str() == std::string(10'000, 'b') + initial.substr(5'000));
+    };
+
+    // The writer keeps the text a sequence of 9-char blocks, each a letter
+    // repeated 8 times and a newline, and publishes after every whole edit.
+    // Any version a reader sees that breaks that shape was torn.
+    "Readers Never See Torn Edits"_test = []<class Layout>() {
+        constexpr int block = 9;
+        auto make_block = [](const char c) { return std::string(block - 1, c) + '\n'; };
+
+        std::string initial;
+        for (int i = 0; i < 1'000; i++) {
+            initial += make_block(static_cast<char>('a' + i % 26));
+        }
+        auto shared =
+            ConcurrentTwinArray<char, Layout::value>(TwinArray<char, Layout::value>(initial));
+
+        std::atomic<bool> stop = false;
+        std::atomic<int> torn = 0;
+        std::atomic<long> reads = 0;
+        auto reader = [&] {
+            while (!stop) {
+                const std::string text = shared.read().to_str();
+                bool ok = text.size() % block == 0;
+                for (std::size_t i = 0; ok && i < text.size(); i += block) {
+                    ok = text.compare(i, block, make_block(text[i])) == 0;
+                }
+                torn += !ok;
+                reads++;
+            }
+        };
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; i++) {
+            readers.emplace_back(reader);
+        }
+
+        std::mt19937 rng(5);
+        for (int i = 0; i < 20'000; i++) {
+            shared.edit([&](auto& buf) {
+                const int blocks = buf.size() / block;
+                buf.move_to((rng() % (blocks + 1)) * block);
+                if (rng() % 2 == 0 || blocks < 10) {
+                    // Typed a character at a time, so intermediate states
+                    // would be visible if publishing were torn
+                    for (const char c : make_block(static_cast<char>('a' + rng() % 26))) {
+                        buf.push(c);
+                    }
+                } else if (buf.erase_after(block) == 0) {
+                    buf.erase_before(block);
+                }
+            });
+        }
+        while (reads < 100) {
+            std::this_thread::yield();
+        }
+        stop = true;
+        for (auto& thread : readers) {
+            thread.join();
+        }
+
+        expect(torn == 0);
+        expect(shared.read().to_str() == shared.writer().to_str());
+    } | layouts;
+};
+
+ut::suite<"Multiple Cursors"> multiple_cursors = [] {
+    using namespace ut;
+
+    auto cursors_of = [](const TwinCursors& cursors) {
+        return std::vector<std::size_t>(cursors.positions().begin(), cursors.positions().end());
+    };
+
+    "Kept Sorted And Distinct"_test = [&] {
+        auto cursors = TwinCursors {7, 2, 7, 0};
+        cursors.add(4);
+        cursors.add(2);
+        cursors.remove(0);
+        expect(cursors_of(cursors) == std::vector<std::size_t> {2, 4, 7});
+
+        auto buf = TwinArray<char>(std::string_view("abcdefgh"));
+        cursors.move_by(buf, 3);
+        expect(cursors_of(cursors) == std::vector<std::size_t> {5, 7, 8});
+        cursors.move_by(buf, 1);
+        expect(cursors_of(cursors) == std::vector<std::size_t> {6, 8});
+        cursors.move_by(buf, -10);
+        expect(cursors_of(cursors) == std::vector<std::size_t> {0});
+    };
+
+    "Insert At Every Cursor"_test = [&] {
+        auto buf = TwinArray<char>(std::string_view("one\ntwo\nthree"));
+        auto cursors = TwinCursors {0, 4, 8};
+        cursors.insert(buf, std::string_view("- "));
+        expect(buf.to_str() == "- one\n- two\n- three");
+        expect(cursors_of(cursors) == std::vector<std::size_t> {2, 8, 14});
+        expect(buf.curr_line_index() == 3_i);
+        expect(buf.curr_char_index() == 2_i);
+        expect(buf.line_count() == 3_u);
+
+        cursors.push(buf, '>');
+        expect(buf.to_str() == "- >one\n- >two\n- >three");
+        expect(cursors_of(cursors) == std::vector<std::size_t> {3, 10, 17});
+
+        expect(throws<std::out_of_range>([&] { TwinCursors {100}.push(buf, 'x'); }));
+        expect(buf.to_str() == "- >one\n- >two\n- >three");
+    };
+
+    "Insert From The Buffer"_test = [&] {
+        auto buf = TwinArray<char>(std::string_view("ab"));
+        buf.shrink_to_fit();
+        auto cursors = TwinCursors {0, 1, 2};
+        cursors.insert(buf, buf.lhs_span());
+        expect(buf.to_str() == "abaabbab");
+        expect(cursors_of(cursors) == std::vector<std::size_t> {2, 5, 8});
+    };
+
+    "Deletes Stop At Neighbours"_test = [&] {
+        auto buf = TwinArray<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+        auto cursors = TwinCursors {2, 3, 8};
+        expect(cursors.erase_before(buf, 2) == 5_u);
+        expect(std::ranges::equal(buf, std::vector {3, 4, 5, 8, 9}));
+        expect(cursors_of(cursors) == std::vector<std::size_t> {0, 3});
+
+        expect(cursors.erase_after(buf, 3) == 5_u);
+        expect(buf.empty());
+        expect(cursors_of(cursors) == std::vector<std::size_t> {0});
+    };
+
+    "One Undo Step"_test = [&] {
+        auto buf = TwinArray<char>(std::string_view("a b c"));
+        buf.enable_journal();
+        auto cursors = TwinCursors {1, 3, 5};
+        cursors.insert(buf, std::string_view("!!"));
+        cursors.erase_before(buf, 1);
+        expect(buf.to_str() == "a! b! c!");
+
+        expect(buf.undo());
+        expect(buf.to_str() == "a!! b!! c!!");
+        expect(buf.undo());
+        expect(buf.to_str() == "a b c");
+        expect(!buf.can_undo());
+        expect(buf.redo());
+        expect(buf.to_str() == "a!! b!! c!!");
+    };
+
+    // Every batched edit against the same edits made one cursor at a time
+    // on a std::string
+    "Matches Single Cursor Edits"_test = []<class Layout>() {
+        std::mt19937 rng(11);
+        auto buf = TwinArray<char, Layout::value>();
+        std::string expected;
+        auto cursors = TwinCursors {0};
+
+        for (int i = 0; i < 2'000; i++) {
+            const auto positions = cursors.positions();
+            std::vector<std::size_t> before(positions.begin(), positions.end());
+            const std::size_t count = rng() % 4;
+            switch (rng() % 5) {
+                case 0:
+                    cursors.add(rng() % (expected.size() + 1));
+                    break;
+                case 1:
+                case 2: {
+                    const std::string text(count + 1, static_cast<char>('a' + rng() % 26));
+                    cursors.insert(buf, text);
+                    for (auto it = before.rbegin(); it != before.rend(); it++) {
+                        expected.insert(*it, text);
+                    }
+                    break;
+                }
+                case 3: {
+                    cursors.erase_before(buf, count);
+                    std::size_t prev = 0;
+                    std::string next;
+                    for (const std::size_t pos : before) {
+                        next += expected.substr(prev, pos - std::min(count, pos - prev) - prev);
+                        prev = pos;
+                    }
+                    expected = next + expected.substr(prev);
+                    break;
+                }
+                case 4: {
+                    cursors.erase_after(buf, count);
+                    std::string next;
+                    std::size_t prev = 0;
+                    for (std::size_t j = 0; j < before.size(); j++) {
+                        const std::size_t end =
+                            j + 1 < before.size() ? before[j + 1] : expected.size();
+                        next += expected.substr(prev, before[j] - prev);
+                        prev = before[j] + std::min(count, end - before[j]);
+                    }
+                    expected = next + expected.substr(prev);
+                    break;
+                }
+            }
+            if (buf.to_str() != expected) {
+                expect(false) << "mismatch at step" << i;
+                return;
+            }
+        }
+    } | layouts;
+};
+
+ut::suite<"Line Index"> line_index = [] {
+    using namespace ut;
+
+    "Lines"_test = [] {
+        auto buf = TwinArray<char>(std::string_view("one\ntwo\n\nfour"));
+        buf.move_to(5);
+
+        expect(buf.line_count() == 4u);
+        expect(buf.line_start(1) == 0u);
+        expect(buf.line_start(2) == 4u);
+        expect(buf.line_start(3) == 8u);
+        expect(buf.line_start(4) == 9u);
+        expect(buf.line(1) == "one");
+        expect(buf.line(2) == "two");
+        expect(buf.line(3) == "");
+        expect(buf.line(4) == "four");
+        expect(buf.curr_line_index() == 2);
+        expect(buf.get_current_line() == "two");
+        expect(throws<std::out_of_range>([&] { (void)buf.line(5); }));
+        expect(throws<std::out_of_range>([&] { (void)buf.line_start(0); }));
+    };
+
+    // Replays random edits against a std::string and checks the index
+    // against a full rescan after each one
+    "Matches Rescan"_test = []<class Layout>() {
+        auto buf = TwinArray<char, Layout::value>(4);
+        std::string model;
+        std::size_t cursor = 0;
+        std::mt19937 rng(42);
+
+        for (int step = 0; step < 2000; step++) {
+            switch (rng() % 8) {
+                case 0:
+                case 1: {
+                    const char c = rng() % 3 == 0 ? '\n' : 'a';
+                    buf.push(c);
+                    model.insert(model.begin() + cursor++, c);
+                    break;
+                }
+                case 2:
+                    if (buf.pop().has_value()) {
+                        model.erase(--cursor, 1);
+                    }
+                    break;
+                case 3:
+                    buf.move_left();
+                    cursor -= cursor > 0;
+                    break;
+                case 4:
+                    buf.move_right();
+                    cursor += cursor < model.size();
+                    break;
+                case 5:
+                    cursor = rng() % (model.size() + 1);
+                    buf.move_to(cursor);
+                    break;
+                case 6: {
+                    const std::string text = step % 2 ? "x\ny\n" : "zz";
+                    buf.insert(text);
+                    model.insert(cursor, text);
+                    cursor += text.size();
+                    break;
+                }
+                case 7: {
+                    const std::size_t n = rng() % 4;
+                    if (step % 2) {
+                        const std::size_t removed = buf.erase_before(n);
+                        model.erase(cursor - removed, removed);
+                        cursor -= removed;
+                    } else {
+                        model.erase(cursor, buf.erase_after(n));
+                    }
+                    break;
+                }
+            }
+
+            const auto before = std::string_view(model).substr(0, cursor);
+            const int line = std::ranges::count(before, '\n') + 1;
+            expect((buf.curr_line_index() == line) >> fatal);
+
+            const std::size_t nl = before.find_last_of('\n');
+            const int col = (cursor - (nl == std::string_view::npos ? 0 : nl)) - 1;
+            expect((buf.curr_char_index() == col) >> fatal);
+
+            const auto breaks = static_cast<std::size_t>(std::ranges::count(model, '\n'));
+            expect((buf.line_count() == breaks + 1) >> fatal);
+        }
+
+        std::size_t start = 0;
+        for (std::size_t n = 1; n <= buf.line_count(); n++) {
+            const std::size_t end = std::min(model.find('\n', start), model.size());
+            expect(buf.line_start(n) == start);
+            expect(buf.line(n) == model.substr(start, end - start));
+            start = end + 1;
+        }
+        expect(buf.to_str() == model);
+    } | layouts;
+
+    "Read Only Elements"_test = [] {
+        // Writes through references would go around the index
+        using Text = TwinArray<char>;
+        auto buf = Text(std::string_view("a b"));
+        static_assert(std::is_same_v<decltype(buf[0]), const char&>);
+        static_assert(std::is_same_v<decltype(buf.back()), const char&>);
+        static_assert(std::is_same_v<decltype(buf.begin()), Text::const_iterator>);
+        static_assert(std::is_same_v<decltype(buf.rhs_span()), std::span<const char>>);
+        static_assert(!std::ranges::output_range<Text, char>);
+        static_assert(std::ranges::random_access_range<Text>);
+
+        expect(std::ranges::count(buf, ' ') == 1);
+        expect(buf.line_count() == 1u);
+    };
+
+    "Survives Copies"_test = [] {
+        auto copy = TwinArray<char>(std::string_view("a\nb\nc"));
+        copy.move_to(2);
+        auto other = copy;
+        other.resize(100);
+        expect(other.line(3) == "c");
+        expect(other.curr_line_index() == 2);
+    };
+};
+
+ut::suite<"Byte Search"> byte_search = [] {
+    using namespace ut;
+    namespace detail = twin_array_detail;
+
+    "Kernels Agree"_test = [] {
+        std::vector<detail::ByteKernels> kernels = {detail::scalar_kernels};
+#ifdef TWIN_ARRAY_X86_SIMD
+        kernels.push_back(detail::sse2_kernels);
+        if (__builtin_cpu_supports("avx2")) {
+            kernels.push_back(detail::avx2_kernels);
+        }
+#endif
+
+        std::mt19937 rng(7);
+        std::string data(300, '\0');
+        for (auto& c : data) {
+            c = rng() % 16 == 0 ? '\n' : 'a' + rng() % 26;
+        }
+
+        for (std::size_t offset = 0; offset < 8; offset++) {
+            for (std::size_t len = 0; len + offset <= data.size(); len += 13) {
+                const std::string_view view(data.data() + offset, len);
+                const std::size_t first = view.find('\n');
+                const std::size_t last = view.rfind('\n');
+                const auto newlines = static_cast<std::size_t>(std::ranges::count(view, '\n'));
+
+                for (const auto& k : kernels) {
+                    const char* found = k.find(view.data(), len, '\n');
+                    const char* rfound = k.rfind(view.data(), len, '\n');
+
+                    expect(k.count(view.data(), len, '\n') == newlines);
+                    expect(found == (first == view.npos ? nullptr : view.data() + first));
+                    expect(rfound == (last == view.npos ? nullptr : view.data() + last));
+                    expect(k.ascii(view.data(), len) == len);
+                }
+            }
+        }
+
+        // One non-ASCII byte at each position, with the run ending in every
+        // lane of a vector and in the scalar tail
+        for (std::size_t pos = 0; pos < 100; pos++) {
+            std::string text(100, 'a');
+            text[pos] = '\xC3';
+            for (const auto& k : kernels) {
+                expect(k.ascii(text.data(), text.size()) == pos);
+                expect(k.ascii(text.data(), pos) == pos);
+            }
+        }
+    };
+
+    "Count"_test = [] {
+        auto buf = TwinArray<char>(std::string_view("a\nb\nc\n"));
+        buf.move_to(3);
+        expect(buf.count('\n') == 3u);
+        expect(buf.count('b') == 1u);
+        expect(buf.count('z') == 0u);
+        // Other character types convert to char rather than picking another overload
+        expect(buf.count(static_cast<unsigned char>('b')) == 1u);
+        expect(buf.count(int {'c'}) == 1u);
+    };
+
+    "Find Next And Prev"_test = []<class Layout>() {
+        const std::string s = std::string(100, 'a') + "\n" + std::string(50, 'b') + "\nc";
+        auto buf = TwinArray<char, Layout::value>(s);
+
+        buf.move_to(120);
+        expect(buf.find_prev('\n') == 100u);
+        expect(buf.find_next('\n') == 151u);
+        expect(buf.find_next('a') == buf.npos);
+        expect(buf.find_prev('a') == 99u);
+
+        buf.move_to(0);
+        expect(buf.find_prev('\n') == buf.npos);
+        expect(buf.find_next('\n') == 100u);
+        expect(buf.find_next('c') == s.size() - 1);
+    } | layouts;
+
+    "Find Substring"_test = [] {
+        should("Across the cursor") = [] {
+            auto buf = TwinArray<char>(std::string_view("the quick brown fox"));
+            buf.move_to(6);
+
+            expect(buf.find("quick") == 4u);
+            expect(buf.find("fox") == 16u);
+            expect(buf.find("the", 1) == buf.npos);
+            expect(buf.find("") == 0u);
+            expect(buf.rfind("o") == 17u);
+            expect(buf.rfind("o", 16) == 12u);
+            expect(buf.rfind("quick", 3) == buf.npos);
+        };
+
+        should("Find all") = [] {
+            auto buf = TwinArray<char, TwinLayout::gap>(std::string_view("aaaa-aa-aaa"));
+            buf.move_to(5);
+
+            expect(buf.find_all("aa") == std::vector<std::size_t> {0, 2, 5, 8});
+            expect(buf.find_all("-") == std::vector<std::size_t> {4, 7});
+            expect(buf.find_all("b").empty());
+        };
+
+        should("Match std::string") = []<class Layout>() {
+            std::mt19937 rng(3);
+            std::string text(500, '\0');
+            for (auto& c : text) {
+                c = 'a' + rng() % 3;
+            }
+            auto buf = TwinArray<char, Layout::value>(text);
+            const std::vector<std::string> needles = {"a", "ab", "cab", "abcab", "ccc", "d"};
+
+            for (std::size_t cursor = 0; cursor <= text.size(); cursor += 37) {
+                buf.move_to(cursor);
+                for (const auto& needle : needles) {
+                    for (std::size_t from = 0; from < text.size(); from += 53) {
+                        expect((buf.find(needle, from) == text.find(needle, from)) >> fatal);
+                        expect((buf.rfind(needle, from) == text.rfind(needle, from)) >> fatal);
+                    }
+                }
+            }
+        } | layouts;
+    };
+};
+
+ut::suite<"UTF-8"> utf8 = [] {
+    using namespace ut;
+
+    // a, é, €, 😀, b: 1, 2, 3, 4 and 1 bytes
+    static constexpr std::string_view mixed = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80" "b";
+
+    "Codepoint Moves"_test = []<class Layout>() {
+        auto buf = TwinArray<char, Layout::value>(mixed);
+        std::vector<std::size_t> stops;
+        for (int i = 0; i < 6; i++) {
+            buf.move_left(TwinUnit::codepoint);
+            stops.push_back(buf.column(TwinUnit::byte));
+        }
+        expect(stops == std::vector<std::size_t> {10, 6, 3, 1, 0, 0});
+
+        buf.move_right(TwinUnit::codepoint);
+        buf.move_right(TwinUnit::codepoint);
+        expect(buf.column(TwinUnit::byte) == 3u);
+
+        // From inside a sequence each stray byte is a step of its own
+        buf.move_to(8);
+        buf.move_right(TwinUnit::codepoint);
+        expect(buf.column(TwinUnit::byte) == 9u);
+        buf.move_left(TwinUnit::codepoint);
+        buf.move_left(TwinUnit::codepoint);
+        expect(buf.column(TwinUnit::byte) == 7u);
+    } | layouts;
+
+    "Grapheme Moves"_test = []<class Layout>() {
+        // e + combining acute, x, two flags and a lone regional
+        // indicator, a ZWJ family, then "\r\n" and z
+        auto buf = TwinArray<char, Layout::value>(std::string_view(
+            "e\xCC\x81x"
+            "\xF0\x9F\x87\xAB\xF0\x9F\x87\xB7\xF0\x9F\x87\xA9\xF0\x9F\x87\xAA\xF0\x9F\x87\xAF"
+            "\xF0\x9F\x91\xA8\xE2\x80\x8D\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x91\xA7"
+            "\r\nz"));
+        const std::vector<std::size_t> bounds = {0, 3, 4, 12, 20, 24, 42, 44, 45};
+        const auto cursor = [&] {
+            return (buf.curr_line_index() == 1 ? 0 : 44) + buf.column(TwinUnit::byte);
+        };
+
+        std::vector<std::size_t> stops;
+        buf.move_to(0);
+        while (stops.size() < bounds.size()) {
+            stops.push_back(cursor());
+            buf.move_right(TwinUnit::grapheme);
+        }
+        expect(stops == bounds);
+
+        stops.clear();
+        while (stops.size() < bounds.size()) {
+            stops.insert(stops.begin(), cursor());
+            buf.move_left(TwinUnit::grapheme);
+        }
+        expect(stops == bounds);
+    } | layouts;
+
+    "Columns"_test = [] {
+        auto buf = TwinArray<char>(std::string_view("first line\n"));
+        buf.insert(mixed);
+        expect(buf.column(TwinUnit::byte) == 11u);
+        expect(buf.column(TwinUnit::codepoint) == 5u);
+        expect(buf.column(TwinUnit::grapheme) == 5u);
+        expect(buf.display_column() == 6u);
+
+        buf.move_left(TwinUnit::codepoint);
+        buf.move_left(TwinUnit::codepoint);
+        expect(buf.column(TwinUnit::codepoint) == 3u);
+        expect(buf.display_column() == 3u);
+
+        // Tabs, wide CJK, a combining mark and an emoji presentation selector
+        auto text = TwinArray<char>(std::string_view(
+            "\tab\t\xE4\xB8\xAD\xE6\x96\x87"
+            "e\xCC\x81\xE2\x9D\xA4\xEF\xB8\x8F|"));
+        expect(text.column(TwinUnit::codepoint) == 11u);
+        expect(text.column(TwinUnit::grapheme) == 9u);
+        expect(text.display_column(4) == 16u);
+        expect(text.display_column() == 24u);
+    };
+
+    "Validation"_test = [] {
+        const std::vector<std::pair<std::string_view, std::size_t>> cases = {
+            {mixed, TwinArray<char>::npos},
+            {"", TwinArray<char>::npos},
+            {"ok\xC0\x80", 2},                   // overlong
+            {"\xE0\x80\xAF", 0},                 // overlong
+            {"ab\xED\xA0\x80", 2},               // surrogate
+            {"\xF4\x90\x80\x80", 0},             // past U+10FFFF
+            {"abc\xE2\x82", 3},                  // cut short
+            {"a\x80", 1},                        // stray continuation
+            {"\xEF\xBF\xBD\xFF", 3},             // U+FFFD is fine, 0xFF never is
+        };
+
+        for (const auto& [text, invalid] : cases) {
+            auto buf = TwinArray<char>(text);
+            // Wherever the cursor splits the text
+            for (std::size_t pos = 0; pos <= text.size(); pos++) {
+                buf.move_to(pos);
+                expect(buf.find_invalid_utf8() == invalid) << text << "split at" << pos;
+                expect(buf.valid_utf8() == (invalid == TwinArray<char>::npos));
+            }
+        }
+    };
+
+    "Long ASCII Runs"_test = [] {
+        std::string text(1000, 'x');
+        text.insert(777, "\xC3\xA9");
+        auto buf = TwinArray<char>(text);
+        expect(buf.valid_utf8());
+        expect(buf.column(TwinUnit::codepoint) == 1001u);
+        expect(buf.display_column() == 1001u);
+
+        buf.move_to(500);
+        buf.push('\xFF');
+        expect(buf.find_invalid_utf8() == 500u);
+        buf.move_to(200);
+        expect(buf.find_invalid_utf8() == 500u);
+    };
+};
+
+// Each check builds its buffer inside the constant expression: C++20 frees
+// every allocation before the evaluation ends, so only plain values come out
+ut::suite<"Constant Evaluation"> constant_evaluation = [] {
+    using namespace ut;
+
+    "Push And Pop"_test = [] {
+        static_assert([] {
+            TwinArray<int> buf = {1, 2, 3};
+            buf.push(4);
+            const auto last = buf.pop();
+            return buf.size() == 3 && last == 4 && buf.back() == 3;
+        }());
+
+        static_assert([] {
+            auto buf = TwinArray<int>(2);
+            for (int i = 0; i < 100; i++) {
+                buf.push(i);
+            }
+            return buf.size() == 100 && buf.at(99) == 99 && buf.total_capacity() >= 100;
+        }());
+    };
+
+    "Cursor Moves"_test = []<class Layout>() {
+        static_assert([] {
+            TwinArray<int, Layout::value> buf = {1, 2, 3, 4};
+            buf.move_left();
+            buf.move_left();
+            buf.push(9);
+            buf.move_right();
+            const auto popped = buf.pop();
+            int sum = 0;
+            for (const int val : buf) {
+                sum = sum * 10 + val;
+            }
+            return sum == 1294 && popped == 3 && buf.at(2) == 9 && buf.after_cursor() == 4;
+        }());
+    } | layouts;
+
+    "Copies And Moves"_test = [] {
+        static_assert([] {
+            TwinArray<int> buf = {1, 2, 3};
+            buf.move_left();
+            auto copy = buf;
+            auto moved = std::move(buf);
+            copy.push(7);
+            return copy.size() == 4 && moved.size() == 3 && copy.at(2) == 7 && moved.at(2) == 3;
+        }());
+    };
+
+    "Text"_test = []<class Layout>() {
+        static_assert([] {
+            auto buf = TwinArray<char, Layout::value>(std::string_view("one\ntwo\nthree"));
+            buf.move_left();
+            buf.move_left();
+            buf.push('-');
+            return buf.to_str() == "one\ntwo\nthr-ee" && buf.line_count() == 3 &&
+                   buf.line(2) == "two" && buf.curr_line_index() == 3 &&
+                   buf.find("two") == 4 && buf.count('\n') == 2 && buf.find_prev('\n') == 7;
+        }());
+    } | layouts;
+
+    "Block Transfers"_test = []<class Layout>() {
+        static_assert([] {
+            auto buf = TwinArray<char, Layout::value>(4);
+            buf.insert(std::string_view("ab\ncd\nef"));
+            buf.move_to(1);
+            buf.move_to(7);
+            buf.move_to(2);
+            auto copy = buf;
+            copy.resize(64);
+            copy.move_to(copy.size());
+            return copy.to_str() == "ab\ncd\nef" && copy.line_count() == 3 &&
+                   copy.line(2) == "cd" && buf.curr_line_index() == 1 && buf.at(6) == 'e';
+        }());
+    } | layouts;
+
+    "UTF-8"_test = [] {
+        static_assert([] {
+            auto buf = TwinArray<char>(std::string_view("a\xC3\xA9\n\t\xE4\xB8\xAD" "e\xCC\x81"));
+            const bool end = buf.column(TwinUnit::grapheme) == 3 && buf.display_column() == 11;
+            buf.move_left(TwinUnit::grapheme);
+            buf.move_left(TwinUnit::codepoint);
+            return end && buf.column(TwinUnit::byte) == 1 && buf.valid_utf8();
+        }());
+    };
+};
+
 int main() {}
@@ -0,0 +1,64 @@
+// Tests for the TwinStats instrumentation. They need TWIN_ARRAY_STATS, so
+// they live in their own binary and main.cpp checks the default build,
+// where the counters compile to nothing.
+
+#include <sstream>
+
+#define TWIN_ARRAY_STATS
+#include "twin_array.h"
+#include "ut.hpp"
+
+namespace ut = boost::ut;
+
+ut::suite<"Stats"> stats = [] {
+    using namespace ut;
+
+    "Counts Edits And Reads"_test = [] {
+        auto buf = TwinArray<int>(4);
+        for (int i = 0; i < 10; i++) {
+            buf.push(i);
+        }
+        (void)buf.pop();
+        buf.move_left();
+        buf.move_left();
+        buf.move_right();
+        buf.move_to(2);
+        (void)buf.at(0);
+        (void)buf.at(1);
+        (void)buf.at(5);
+
+        const TwinStats stats = buf.stats();
+        expect(stats.pushes == 10_u);
+        expect(stats.pops == 1_u);
+        expect(stats.cursor_moves == 9_u);
+        expect(stats.lhs_reads == 2_u);
+        expect(stats.rhs_reads == 1_u);
+        expect(stats.resizes == 2_u);
+        expect(stats.bytes_copied == (4 + 8) * sizeof(int));
+        expect(stats.peak_capacity == 16_u);
+
+        buf.shrink_to_fit();
+        expect(buf.stats().peak_capacity == 16_u);
+
+        std::ostringstream out;
+        out << buf.stats();
+        expect(out.str().starts_with("resizes 3, bytes copied 84, cursor moves 9, pushes 10"));
+
+        buf.reset_stats();
+        expect(buf.stats().resizes == 0_u);
+        expect(buf.stats().peak_capacity == 9_u);
+    };
+
+    "Stay With The Object"_test = [] {
+        auto a = TwinArray<int>({1, 2, 3});
+        a.push(4);
+        auto b = a;
+        expect(b.stats().pushes == 0_u);
+
+        auto c = std::move(a);
+        expect(c.stats().pushes == 0_u);
+        expect(a.stats().pushes == 1_u);
+    };
+};
+
+int main() {}
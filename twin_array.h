@@ -2,31 +2,681 @@
 #define TWIN_ARRAY_H
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <memory_resource>
+#include <new>
 #include <optional>
 #include <ranges>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __has_include(<sys/uio.h>) && __has_include(<unistd.h>) && __has_include(<sys/mman.h>)
+#define TWIN_ARRAY_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if !defined(TWIN_ARRAY_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TWIN_ARRAY_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
-// TODO: Iterator?
 // TODO: `using`
 // TODO: Static asserts and exceptions
 
+// Byte scanning kernels behind the TwinArray<char> search methods. On x86-64
+// the SSE2 or AVX2 version is picked at runtime; define TWIN_ARRAY_NO_SIMD
+// to always use the scalar one.
+namespace twin_array_detail {
+    using count_fn = std::size_t (*)(const char*, std::size_t, char);
+    using find_fn = const char* (*)(const char*, std::size_t, char);
+    using ascii_fn = std::size_t (*)(const char*, std::size_t);
+
+    struct ByteKernels {
+        count_fn count;
+        find_fn find;    // first match, or nullptr
+        find_fn rfind;   // last match, or nullptr
+        ascii_fn ascii;  // length of the leading run of ASCII bytes
+    };
+
+    constexpr std::size_t count_scalar(const char* data, std::size_t len, char c) {
+        return std::count(data, data + len, c);
+    }
+
+    constexpr const char* find_scalar(const char* data, std::size_t len, char c) {
+        if (std::is_constant_evaluated()) {
+            const char* it = std::find(data, data + len, c);
+            return it == data + len ? nullptr : it;
+        }
+        return len == 0 ? nullptr : static_cast<const char*>(std::memchr(data, c, len));
+    }
+
+    constexpr const char* rfind_scalar(const char* data, std::size_t len, char c) {
+        for (std::size_t i = len; i > 0; i--) {
+            if (data[i - 1] == c) {
+                return data + i - 1;
+            }
+        }
+        return nullptr;
+    }
+
+    constexpr std::size_t ascii_scalar(const char* data, std::size_t len) {
+        std::size_t i = 0;
+        while (i < len && static_cast<unsigned char>(data[i]) < 0x80) {
+            i++;
+        }
+        return i;
+    }
+
+    inline constexpr ByteKernels scalar_kernels = {
+        count_scalar, find_scalar, rfind_scalar, ascii_scalar};
+
+#ifdef TWIN_ARRAY_X86_SIMD
+    inline std::size_t count_sse2(const char* data, std::size_t len, char c) {
+        const __m128i needle = _mm_set1_epi8(c);
+        std::size_t total = 0;
+        std::size_t i = 0;
+        for (; i + 16 <= len; i += 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            total += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+        }
+        return total + count_scalar(data + i, len - i, c);
+    }
+
+    inline const char* find_sse2(const char* data, std::size_t len, char c) {
+        const __m128i needle = _mm_set1_epi8(c);
+        std::size_t i = 0;
+        for (; i + 16 <= len; i += 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+            if (mask != 0) {
+                return data + i + __builtin_ctz(mask);
+            }
+        }
+        return find_scalar(data + i, len - i, c);
+    }
+
+    inline const char* rfind_sse2(const char* data, std::size_t len, char c) {
+        const __m128i needle = _mm_set1_epi8(c);
+        std::size_t i = len;
+        for (; i >= 16; i -= 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i - 16));
+            const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+            if (mask != 0) {
+                return data + i - 16 + (31 - __builtin_clz(mask));
+            }
+        }
+        return rfind_scalar(data, i, c);
+    }
+
+    inline std::size_t ascii_sse2(const char* data, std::size_t len) {
+        std::size_t i = 0;
+        for (; i + 16 <= len; i += 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            const int mask = _mm_movemask_epi8(chunk);
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return i + ascii_scalar(data + i, len - i);
+    }
+
+    __attribute__((target("avx2"))) inline std::size_t count_avx2(
+        const char* data, std::size_t len, char c) {
+        const __m256i needle = _mm256_set1_epi8(c);
+        std::size_t total = 0;
+        std::size_t i = 0;
+        for (; i + 32 <= len; i += 32) {
+            const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            total += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+        }
+        return total + count_sse2(data + i, len - i, c);
+    }
+
+    __attribute__((target("avx2"))) inline const char* find_avx2(
+        const char* data, std::size_t len, char c) {
+        const __m256i needle = _mm256_set1_epi8(c);
+        std::size_t i = 0;
+        for (; i + 32 <= len; i += 32) {
+            const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            const unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+            if (mask != 0) {
+                return data + i + __builtin_ctz(mask);
+            }
+        }
+        return find_sse2(data + i, len - i, c);
+    }
+
+    __attribute__((target("avx2"))) inline const char* rfind_avx2(
+        const char* data, std::size_t len, char c) {
+        const __m256i needle = _mm256_set1_epi8(c);
+        std::size_t i = len;
+        for (; i >= 32; i -= 32) {
+            const __m256i chunk =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i - 32));
+            const unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+            if (mask != 0) {
+                return data + i - 32 + (31 - __builtin_clz(mask));
+            }
+        }
+        return rfind_sse2(data, i, c);
+    }
+
+    __attribute__((target("avx2"))) inline std::size_t ascii_avx2(
+        const char* data, std::size_t len) {
+        std::size_t i = 0;
+        for (; i + 32 <= len; i += 32) {
+            const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            const unsigned mask = _mm256_movemask_epi8(chunk);
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return i + ascii_sse2(data + i, len - i);
+    }
+
+    inline constexpr ByteKernels sse2_kernels = {count_sse2, find_sse2, rfind_sse2, ascii_sse2};
+    inline constexpr ByteKernels avx2_kernels = {count_avx2, find_avx2, rfind_avx2, ascii_avx2};
+#endif
+
+    // Best kernels for the running CPU, resolved on first use
+    inline const ByteKernels& byte_kernels() {
+#ifdef TWIN_ARRAY_X86_SIMD
+        static const ByteKernels& kernels =
+            __builtin_cpu_supports("avx2") ? avx2_kernels : sse2_kernels;
+        return kernels;
+#else
+        return scalar_kernels;
+#endif
+    }
+
+    // The scalar kernels during constant evaluation, byte_kernels() otherwise
+    constexpr const ByteKernels& kernels() {
+        if (std::is_constant_evaluated()) {
+            return scalar_kernels;
+        }
+        return byte_kernels();
+    }
+
+    // UTF-8 decoding and a compact subset of the Unicode tables, for the
+    // TwinArray<char> codepoint and grapheme functions. The tables cover the
+    // common combining marks, East Asian wide characters and emoji; they are
+    // an approximation, not the full Unicode character database.
+    struct Utf8Char {
+        char32_t cp;      // U+FFFD when invalid
+        std::size_t len;  // bytes taken, 1 when invalid
+        bool valid;
+    };
+
+    // Decode the sequence at the start of `bytes`. Anything outside the
+    // well-formed ranges of Unicode table 3-7, which rules out overlong
+    // forms, surrogates and code points past U+10FFFF, is invalid, as is a
+    // sequence cut short by `avail`.
+    constexpr Utf8Char utf8_decode(const unsigned char* bytes, const std::size_t avail) {
+        constexpr Utf8Char invalid = {0xFFFD, 1, false};
+        const unsigned char lead = bytes[0];
+        if (lead < 0x80) {
+            return {lead, 1, true};
+        }
+
+        std::size_t len = 0;
+        char32_t cp = 0;
+        unsigned char lo = 0x80;
+        unsigned char hi = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            len = 2;
+            cp = lead & 0x1F;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            len = 3;
+            cp = lead & 0x0F;
+            lo = lead == 0xE0 ? 0xA0 : 0x80;
+            hi = lead == 0xED ? 0x9F : 0xBF;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            len = 4;
+            cp = lead & 0x07;
+            lo = lead == 0xF0 ? 0x90 : 0x80;
+            hi = lead == 0xF4 ? 0x8F : 0xBF;
+        } else {
+            return invalid;
+        }
+
+        if (avail < len) {
+            return invalid;
+        }
+        for (std::size_t i = 1; i < len; i++) {
+            if (bytes[i] < lo || bytes[i] > hi) {
+                return invalid;
+            }
+            cp = (cp << 6) | (bytes[i] & 0x3F);
+            lo = 0x80;
+            hi = 0xBF;
+        }
+        return {cp, len, true};
+    }
+
+    constexpr bool is_continuation(const char c) {
+        return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+    }
+
+    struct CodepointRange {
+        char32_t first;
+        char32_t last;
+    };
+
+    // Marks and modifiers that never start a grapheme cluster. Hangul
+    // medial vowels and final consonants are included so jamo sequences
+    // stay together.
+    inline constexpr CodepointRange extend_ranges[] = {
+        {0x0300, 0x036F},   {0x0483, 0x0489},   {0x0591, 0x05BD},   {0x05BF, 0x05BF},
+        {0x05C1, 0x05C2},   {0x05C4, 0x05C5},   {0x05C7, 0x05C7},   {0x0610, 0x061A},
+        {0x064B, 0x065F},   {0x0670, 0x0670},   {0x06D6, 0x06DC},   {0x06DF, 0x06E4},
+        {0x06E7, 0x06E8},   {0x06EA, 0x06ED},   {0x0711, 0x0711},   {0x0730, 0x074A},
+        {0x07A6, 0x07B0},   {0x0E31, 0x0E31},   {0x0E34, 0x0E3A},   {0x0E47, 0x0E4E},
+        {0x0EB1, 0x0EB1},   {0x0EB4, 0x0EBC},   {0x0EC8, 0x0ECD},   {0x0F71, 0x0F84},
+        {0x102B, 0x103E},   {0x1160, 0x11FF},   {0x135D, 0x135F},   {0x17B4, 0x17D3},
+        {0x180B, 0x180F},   {0x1AB0, 0x1AFF},   {0x1DC0, 0x1DFF},   {0x200C, 0x200D},
+        {0x20D0, 0x20FF},   {0x2CEF, 0x2CF1},   {0x2DE0, 0x2DFF},   {0x302A, 0x302F},
+        {0x3099, 0x309A},   {0xA66F, 0xA672},   {0xA674, 0xA67D},   {0xA69E, 0xA69F},
+        {0xA8E0, 0xA8F1},   {0xD7B0, 0xD7FF},   {0xFB1E, 0xFB1E},   {0xFE00, 0xFE0F},
+        {0xFE20, 0xFE2F},   {0x1F3FB, 0x1F3FF}, {0xE0020, 0xE007F}, {0xE0100, 0xE01EF},
+    };
+
+    // Characters a terminal draws two cells wide
+    inline constexpr CodepointRange wide_ranges[] = {
+        {0x1100, 0x115F},   {0x231A, 0x231B},   {0x2329, 0x232A},   {0x23E9, 0x23EC},
+        {0x23F0, 0x23F0},   {0x23F3, 0x23F3},   {0x25FD, 0x25FE},   {0x2614, 0x2615},
+        {0x2648, 0x2653},   {0x267F, 0x267F},   {0x2693, 0x2693},   {0x26A1, 0x26A1},
+        {0x26AA, 0x26AB},   {0x26BD, 0x26BE},   {0x26C4, 0x26C5},   {0x26CE, 0x26CE},
+        {0x26D4, 0x26D4},   {0x26EA, 0x26EA},   {0x26F2, 0x26F3},   {0x26F5, 0x26F5},
+        {0x26FA, 0x26FA},   {0x26FD, 0x26FD},   {0x2705, 0x2705},   {0x270A, 0x270B},
+        {0x2728, 0x2728},   {0x274C, 0x274C},   {0x274E, 0x274E},   {0x2753, 0x2755},
+        {0x2757, 0x2757},   {0x2795, 0x2797},   {0x27B0, 0x27B0},   {0x27BF, 0x27BF},
+        {0x2B1B, 0x2B1C},   {0x2B50, 0x2B50},   {0x2B55, 0x2B55},   {0x2E80, 0x303E},
+        {0x3041, 0x33FF},   {0x3400, 0x4DBF},   {0x4E00, 0x9FFF},   {0xA000, 0xA4CF},
+        {0xA960, 0xA97F},   {0xAC00, 0xD7A3},   {0xF900, 0xFAFF},   {0xFE10, 0xFE19},
+        {0xFE30, 0xFE6F},   {0xFF00, 0xFF60},   {0xFFE0, 0xFFE6},   {0x16FE0, 0x16FE4},
+        {0x17000, 0x18CFF}, {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF},
+        {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F1E6, 0x1F1FF}, {0x1F200, 0x1F251},
+        {0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF}, {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F9FF},
+        {0x1FA70, 0x1FAFF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+    };
+
+    // Emoji that a zero width joiner binds to the one before it
+    inline constexpr CodepointRange pictographic_ranges[] = {
+        {0x00A9, 0x00A9},   {0x00AE, 0x00AE},   {0x203C, 0x203C},   {0x2049, 0x2049},
+        {0x2122, 0x2122},   {0x2139, 0x2139},   {0x2194, 0x21AA},   {0x231A, 0x231B},
+        {0x2328, 0x2328},   {0x23CF, 0x23CF},   {0x23E9, 0x23FA},   {0x24C2, 0x24C2},
+        {0x25AA, 0x25AB},   {0x25B6, 0x25B6},   {0x25C0, 0x25C0},   {0x25FB, 0x25FE},
+        {0x2600, 0x27BF},   {0x2934, 0x2935},   {0x2B05, 0x2B07},   {0x2B1B, 0x2B1C},
+        {0x2B50, 0x2B50},   {0x2B55, 0x2B55},   {0x3030, 0x3030},   {0x303D, 0x303D},
+        {0x3297, 0x3297},   {0x3299, 0x3299},   {0x1F000, 0x1F1E5}, {0x1F200, 0x1F3FA},
+        {0x1F400, 0x1FAFF},
+    };
+
+    template <std::size_t N>
+    constexpr bool in_ranges(const CodepointRange (&ranges)[N], const char32_t cp) {
+        const auto it = std::upper_bound(
+            ranges, ranges + N, cp,
+            [](const char32_t c, const CodepointRange& range) { return c < range.first; });
+        return it != ranges && cp <= (it - 1)->last;
+    }
+
+    constexpr bool is_regional_indicator(const char32_t cp) {
+        return cp >= 0x1F1E6 && cp <= 0x1F1FF;
+    }
+
+    constexpr bool is_control(const char32_t cp) {
+        return cp < 0x20 || (cp >= 0x7F && cp <= 0x9F) || cp == 0x2028 || cp == 0x2029;
+    }
+
+    // Whether `next` continues the grapheme cluster `prev` belongs to, after
+    // the pairwise rules of UAX #29. Two regional indicators only pair up
+    // when an odd number of them come before `next`, which the caller has to
+    // count.
+    constexpr bool grapheme_joins(const char32_t prev, const char32_t next) {
+        if (prev == '\r') {
+            return next == '\n';
+        }
+        if (is_control(prev) || is_control(next)) {
+            return false;
+        }
+        if (in_ranges(extend_ranges, next)) {
+            return true;
+        }
+        if (prev == 0x200D) {
+            return in_ranges(pictographic_ranges, next);
+        }
+        return is_regional_indicator(prev) && is_regional_indicator(next);
+    }
+
+    // Cells a code point takes on a terminal. Tabs are left to the caller.
+    constexpr std::size_t display_width(const char32_t cp) {
+        if (cp < 0x80) {
+            return 1;
+        }
+        if (in_ranges(extend_ranges, cp)) {
+            return 0;
+        }
+        return in_ranges(wide_ranges, cp) ? 2 : 1;
+    }
+
+    // Feed the code points of some text in order to find where its grapheme
+    // clusters start
+    struct GraphemeBreaks {
+        char32_t prev = 0;
+        std::size_t regional = 0;  // regional indicators in a row up to prev
+        bool started = false;
+
+        constexpr bool starts_cluster(const char32_t cp) {
+            bool brk = !started || !grapheme_joins(prev, cp);
+            if (!brk && is_regional_indicator(cp)) {
+                brk = regional % 2 == 0;
+            }
+            regional = is_regional_indicator(cp) ? regional + 1 : 0;
+            prev = cp;
+            started = true;
+            return brk;
+        }
+    };
+
+    // Sole owner of a heap object, like std::unique_ptr, which can only be
+    // used in constant evaluation from C++23
+    template <typename T>
+    class Owned {
+       public:
+        constexpr Owned() noexcept = default;
+        constexpr explicit Owned(T* ptr) noexcept : ptr(ptr) {}
+        constexpr Owned(Owned&& other) noexcept : ptr(std::exchange(other.ptr, nullptr)) {}
+        constexpr Owned& operator=(Owned&& other) noexcept {
+            if (this != &other) {
+                reset();
+                ptr = std::exchange(other.ptr, nullptr);
+            }
+            return *this;
+        }
+        constexpr ~Owned() { reset(); }
+
+        constexpr void reset() noexcept { delete std::exchange(ptr, nullptr); }
+
+        constexpr T* operator->() const noexcept { return ptr; }
+        constexpr T& operator*() const noexcept { return *ptr; }
+        constexpr explicit operator bool() const noexcept { return ptr != nullptr; }
+
+       private:
+        T* ptr = nullptr;
+    };
+
+    // The contents of a TwinArray as snapshot() saw them. The elements stay
+    // in the live buffer's storage; before the buffer overwrites any of them
+    // it copies the surrounding chunk into `lhs_patches` or `rhs_patches`.
+    // Each chunk has one slot there, written at most once with a release
+    // store after the copy is complete, so readers on other threads never
+    // take a lock, and a reader that copied from the live storage checks
+    // the slot again afterwards, like a seqlock, to catch a racing edit.
+    template <typename T>
+    struct FrozenView {
+        static constexpr std::size_t chunk = sizeof(T) >= 4096 ? 1 : 4096 / sizeof(T);
+
+        // One write-once slot per chunk, owning its patch
+        class patch_table {
+           public:
+            patch_table() = default;
+            explicit patch_table(const std::size_t count)
+                : slots(std::make_unique<std::atomic<T*>[]>(count)), count(count) {}
+            patch_table(const patch_table&) = delete;
+            patch_table& operator=(const patch_table&) = delete;
+            ~patch_table() {
+                for (std::size_t k = 0; k < count; k++) {
+                    delete[] slots[k].load(std::memory_order_relaxed);
+                }
+            }
+
+            [[nodiscard]] std::atomic<T*>& operator[](const std::size_t k) const noexcept {
+                return slots[k];
+            }
+
+           private:
+            std::unique_ptr<std::atomic<T*>[]> slots;
+            std::size_t count = 0;
+        };
+
+        // rhs sits at the back of rhs_mem, or of lhs_mem with the gap layout,
+        // where rhs_mem is null
+        FrozenView(std::shared_ptr<const void> storage, const T* lhs_mem, const T* rhs_mem,
+            const std::size_t capacity, const std::size_t lhs_size, const std::size_t rhs_size)
+            : storage(std::move(storage)),
+              lhs_mem(lhs_mem),
+              rhs_mem(rhs_mem),
+              capacity(capacity),
+              lhs_size(lhs_size),
+              rhs_size(rhs_size),
+              lhs_patches(chunks()),
+              rhs_patches(rhs_mem == nullptr ? 0 : chunks()) {}
+
+        std::shared_ptr<const void> storage;
+        const T* lhs_mem;
+        const T* rhs_mem;
+        std::size_t capacity;
+        std::size_t lhs_size;
+        std::size_t rhs_size;
+        patch_table lhs_patches;
+        patch_table rhs_patches;
+
+        // Copy mem[first, last) of one array, which must lie within a single
+        // chunk. The writer patches a chunk before it overwrites it, so a
+        // copy from mem is intact if the slot is still empty once it is done.
+        // ThreadSanitizer reports a copy that overlapped an edit as a race,
+        // though it is thrown away and redone from the patch.
+        static void copy(const T* mem, const patch_table& patches, const std::size_t first,
+            const std::size_t last, T* out) {
+            const std::atomic<T*>& slot = patches[first / chunk];
+            const T* patch = slot.load(std::memory_order_acquire);
+            if (patch == nullptr) {
+                std::copy(mem + first, mem + last, out);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                patch = slot.load(std::memory_order_acquire);
+                if (patch == nullptr) {
+                    return;
+                }
+            }
+            std::copy(patch + first % chunk, patch + (last - first) + first % chunk, out);
+        }
+
+        // Call fn(data, len) on consecutive runs in logical order
+        template <typename Fn>
+        void for_each_chunk(Fn&& fn) const {
+            const auto scratch = std::make_unique_for_overwrite<T[]>(chunk);
+            auto forward = [&](const T* mem, const patch_table& patches, std::size_t first,
+                               const std::size_t last) {
+                while (first < last) {
+                    const std::size_t next = std::min((first / chunk + 1) * chunk, last);
+                    copy(mem, patches, first, next, scratch.get());
+                    fn(static_cast<const T*>(scratch.get()), next - first);
+                    first = next;
+                }
+            };
+
+            forward(lhs_mem, lhs_patches, 0, lhs_size);
+            forward(rhs_array(), rhs_table(), capacity - rhs_size, capacity);
+        }
+
+        [[nodiscard]] T element(const std::size_t idx) const {
+            T ret;
+            if (idx < lhs_size) {
+                copy(lhs_mem, lhs_patches, idx, idx + 1, &ret);
+            } else {
+                const std::size_t at = capacity - rhs_size + (idx - lhs_size);
+                copy(rhs_array(), rhs_table(), at, at + 1, &ret);
+            }
+            return ret;
+        }
+
+        // Called by the live buffer before it overwrites mem[first, last) of
+        // its lhs array (or the whole block with the gap layout)
+        void preserve_lhs(const std::size_t first, const std::size_t last) {
+            const std::size_t back = rhs_mem == nullptr ? capacity - rhs_size : capacity;
+            if ((first < lhs_size || last > back) && first < last) {
+                preserve(lhs_mem, lhs_patches, first, last, lhs_size, back);
+            }
+        }
+
+        // Same for mem[first, last) of the twin layout's rhs array
+        void preserve_rhs(const std::size_t first, const std::size_t last) {
+            if (last > capacity - rhs_size && first < last) {
+                preserve(rhs_mem, rhs_patches, first, last, 0, capacity - rhs_size);
+            }
+        }
+
+       private:
+        [[nodiscard]] std::size_t chunks() const noexcept { return (capacity + chunk - 1) / chunk; }
+        [[nodiscard]] const T* rhs_array() const noexcept {
+            return rhs_mem == nullptr ? lhs_mem : rhs_mem;
+        }
+        [[nodiscard]] const patch_table& rhs_table() const noexcept {
+            return rhs_mem == nullptr ? lhs_patches : rhs_patches;
+        }
+
+        // Frozen slots of the array are [0, front) and [back, capacity).
+        // Only the writer thread calls this.
+        void preserve(const T* mem, patch_table& patches, const std::size_t first,
+            const std::size_t last, const std::size_t front, const std::size_t back) {
+            for (std::size_t k = first / chunk; k <= (last - 1) / chunk; k++) {
+                const std::size_t begin = k * chunk;
+                const std::size_t end = std::min(begin + chunk, capacity);
+                if ((begin >= front && end <= back) ||
+                    patches[k].load(std::memory_order_relaxed) != nullptr) {
+                    continue;
+                }
+
+                auto patch = std::make_unique_for_overwrite<T[]>(chunk);
+                if (begin < front) {
+                    std::copy(mem + begin, mem + std::min(end, front), patch.get());
+                }
+                if (end > back) {
+                    const std::size_t from = std::max(begin, back);
+                    std::copy(mem + from, mem + end, patch.get() + (from - begin));
+                }
+                patches[k].store(patch.release(), std::memory_order_release);
+            }
+            // Keeps the overwrite that follows from becoming visible before
+            // the slots do
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    };
+}  // namespace twin_array_detail
+
+// How a TwinArray lays out its two halves in memory
+//   twin: lhs and rhs each own a capacity-sized array
+//   gap:  a single capacity-sized array, lhs grows from the front and rhs
+//         grows from the back. Uses half the memory of `twin`.
+enum class TwinLayout { twin, gap };
+
+// What TwinArray<char> counts when moving the cursor or measuring columns
+//   byte:      a single char
+//   codepoint: one UTF-8 encoded code point; an invalid byte counts as one
+//   grapheme:  a cluster of code points read as one character, like a
+//              letter and its accents, or an emoji sequence
+enum class TwinUnit { byte, codepoint, grapheme };
+
+// How push() grows a full TwinArray. Capacity is multiplied by `factor`, but
+// never grows by more than `max_step` elements at once, which bounds the
+// cost of any single reallocation on large buffers.
+struct TwinGrowth {
+    double factor = 2.0;
+    std::size_t max_step = std::numeric_limits<std::size_t>::max();
+};
+
+// Counters kept by every TwinArray when TWIN_ARRAY_STATS is defined before
+// this header is included. Without it they are compiled out entirely and
+// stats() does not exist.
+struct TwinStats {
+    // Reallocations of the storage and the element bytes they relocated
+    std::size_t resizes = 0;
+    std::size_t bytes_copied = 0;
+    // Elements carried across the cursor by move_left(), move_right() and
+    // move_to()
+    std::size_t cursor_moves = 0;
+    std::size_t pushes = 0;
+    std::size_t pops = 0;
+    std::size_t peak_capacity = 0;
+    // at() calls that landed before and after the cursor
+    std::size_t lhs_reads = 0;
+    std::size_t rhs_reads = 0;
+
+    friend std::ostream& operator<<(std::ostream& os, const TwinStats& stats) {
+        return os << "resizes " << stats.resizes << ", bytes copied " << stats.bytes_copied
+                  << ", cursor moves " << stats.cursor_moves << ", pushes " << stats.pushes
+                  << ", pops " << stats.pops << ", peak capacity " << stats.peak_capacity
+                  << ", at() lhs " << stats.lhs_reads << " rhs " << stats.rhs_reads;
+    }
+};
+
+#ifdef TWIN_ARRAY_POSIX
+class TwinLoader;
+#endif
+class TwinCursors;
+
 template <typename T>
+class TwinSnapshot;
+
+// With InlineCapacity > 0, up to that many elements per half are kept inside
+// the object itself and the heap is only used once the array outgrows them.
+//
+// Editing, searching and the line index also work in constant expressions,
+// as long as the array is destroyed before the evaluation ends. Inline
+// storage, snapshots, the undo journal and file I/O are runtime only.
+template <
+    typename T,
+    TwinLayout Layout = TwinLayout::twin,
+    typename Allocator = std::allocator<T>,
+    std::size_t InlineCapacity = 0>
 class TwinArray {
+    using alloc_traits = std::allocator_traits<Allocator>;
+
+#ifdef TWIN_ARRAY_POSIX
+    friend class TwinLoader;
+#endif
+    friend class TwinCursors;
+
+    static_assert(std::is_same_v<typename alloc_traits::value_type, T>);
+    static_assert(
+        std::is_same_v<typename alloc_traits::pointer, T*>,
+        "TwinArray does not support fancy pointers");
+    static_assert(
+        InlineCapacity == 0 || std::is_nothrow_move_constructible_v<T>,
+        "inline storage needs nothrow move construction to stay swappable");
+
+    // Element types that snapshot() supports
+    static constexpr bool snapshottable =
+        std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>;
+
    public:
     // member types
     using value_type = T;
-    using allocator_type = std::allocator<T>;
+    using allocator_type = Allocator;
     using size_type = std::size_t;
     using difference_type = std::ptrdiff_t;
     using reference = T&;
     using const_reference = const T&;
-    using pointer = std::allocator_traits<std::allocator<T>>::pointer;
-    using const_pointer = std::allocator_traits<std::allocator<T>>::const_pointer;
+    using pointer = alloc_traits::pointer;
+    using const_pointer = alloc_traits::const_pointer;
 
    private:
     template <typename ptr_type>
@@ -34,20 +684,97 @@ class TwinArray {
        public:
         static const bool is_const = std::is_const_v<std::remove_pointer_t<ptr_type>>;
 
-        using value_type = typename std::conditional<is_const, const T, T>::type;
+        using value_type = T;
         using gapbuffer_ptr_type =
             typename std::conditional<is_const, const TwinArray*, TwinArray*>::type;
         using difference_type = std::ptrdiff_t;
         using pointer = ptr_type;
-        using reference = value_type&;
+        using reference = typename std::conditional<is_const, const T&, T&>::type;
         using iterator_category = std::random_access_iterator_tag;
+        using iterator_concept = std::random_access_iterator_tag;
+
+        constexpr IteratorTemplate() = default;
+        constexpr IteratorTemplate(gapbuffer_ptr_type buf, difference_type idx)
+            : buf(buf), idx(idx) {}
+
+        // iterator -> const_iterator
+        template <typename other_ptr>
+            requires(is_const && !std::is_same_v<other_ptr, ptr_type>)
+        constexpr IteratorTemplate(const IteratorTemplate<other_ptr>& other)
+            : buf(other.buf), idx(other.idx) {}
+
+        constexpr reference operator*() const { return buf->element(idx); }
+        constexpr pointer operator->() const { return &buf->element(idx); }
+        constexpr reference operator[](difference_type n) const { return buf->element(idx + n); }
+
+        constexpr IteratorTemplate& operator++() {
+            idx++;
+            return *this;
+        }
+
+        constexpr IteratorTemplate operator++(int) {
+            auto tmp = *this;
+            idx++;
+            return tmp;
+        }
+
+        constexpr IteratorTemplate& operator--() {
+            idx--;
+            return *this;
+        }
 
-        explicit IteratorTemplate() = default;
+        constexpr IteratorTemplate operator--(int) {
+            auto tmp = *this;
+            idx--;
+            return tmp;
+        }
+
+        constexpr IteratorTemplate& operator+=(difference_type n) {
+            idx += n;
+            return *this;
+        }
+
+        constexpr IteratorTemplate& operator-=(difference_type n) {
+            idx -= n;
+            return *this;
+        }
+
+        friend constexpr IteratorTemplate operator+(IteratorTemplate it, difference_type n) {
+            return it += n;
+        }
+
+        friend constexpr IteratorTemplate operator+(difference_type n, IteratorTemplate it) {
+            return it += n;
+        }
+
+        friend constexpr IteratorTemplate operator-(IteratorTemplate it, difference_type n) {
+            return it -= n;
+        }
+
+        friend constexpr difference_type operator-(
+            const IteratorTemplate& a, const IteratorTemplate& b) {
+            return a.idx - b.idx;
+        }
+
+        friend constexpr bool operator==(const IteratorTemplate& a, const IteratorTemplate& b) {
+            return a.idx == b.idx;
+        }
+
+        friend constexpr auto operator<=>(const IteratorTemplate& a, const IteratorTemplate& b) {
+            return a.idx <=> b.idx;
+        }
 
        private:
+        template <typename>
+        friend class IteratorTemplate;
+
+        gapbuffer_ptr_type buf = nullptr;
+        difference_type idx = 0;
     };
 
    public:
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
     // Iterator member types
     using iterator = IteratorTemplate<pointer>;
     using const_iterator = IteratorTemplate<const_pointer>;
@@ -55,115 +782,159 @@ class TwinArray {
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
     // Constructors
-    constexpr explicit TwinArray(const std::size_t len = 32)
-        : lhs(std::make_unique<T[]>(len)),
-          rhs(std::make_unique<T[]>(len)),
+    // Storage is left uninitialised; only the slots holding elements are
+    // ever constructed.
+    constexpr explicit TwinArray(
+        const std::size_t len = default_capacity, const Allocator& alloc = Allocator())
+        : alloc(alloc),
+          lhs(nullptr),
+          rhs(nullptr),
           lhs_size(0),
           rhs_size(0),
-          capacity(len) {}
+          capacity(len),
+          lines(make_line_index(alloc)) {
+        if constexpr (InlineCapacity > 0) {
+            if (len <= InlineCapacity) {
+                use_inline_storage();
+                return;
+            }
+        }
+
+        lhs = allocate(len);
+        if constexpr (!is_gap) {
+            try {
+                rhs = allocate(len);
+            } catch (...) {
+                deallocate(lhs, len);
+                throw;
+            }
+        }
+    }
+
+    constexpr explicit TwinArray(const Allocator& alloc) : TwinArray(default_capacity, alloc) {}
 
     template <typename InputIt>
-    constexpr explicit TwinArray(InputIt begin, InputIt end)
-        : TwinArray(std::distance(begin, end) + 8) {
-        lhs_size = std::distance(begin, end);
-        std::copy(begin, end, lhs.get());
+    constexpr explicit TwinArray(InputIt begin, InputIt end, const Allocator& alloc = Allocator())
+        : TwinArray(with_slack(std::distance(begin, end)), alloc) {
+        lhs_size = construct_copies(begin, end, lhs) - lhs;
+        index_lines(0);
     }
 
-    constexpr TwinArray(std::initializer_list<T> lst) : TwinArray(lst.size() + 8) {
-        lhs_size = lst.size();
-        std::copy(lst.begin(), lst.end(), lhs.get());
+    constexpr TwinArray(std::initializer_list<T> lst, const Allocator& alloc = Allocator())
+        : TwinArray(with_slack(lst.size()), alloc) {
+        lhs_size = construct_copies(lst.begin(), lst.end(), lhs) - lhs;
+        index_lines(0);
     }
 
-    constexpr explicit TwinArray(std::string_view str)
+    constexpr explicit TwinArray(std::string_view str, const Allocator& alloc = Allocator())
         requires(std::is_same_v<T, char>)
-        : TwinArray(str.size() + 8) {
-        lhs_size = str.size();
-        std::copy(str.begin(), str.end(), lhs.get());
+        : TwinArray(with_slack(str.size()), alloc) {
+        lhs_size = construct_copies(str.begin(), str.end(), lhs) - lhs;
+        index_lines(0);
     }
 
     // Copy Constructor
-    TwinArray(const TwinArray& other)
-        : lhs(std::make_unique<T[]>(other.capacity)),
-          rhs(std::make_unique<T[]>(other.capacity)),
-          lhs_size(other.lhs_size),
-          rhs_size(other.rhs_size),
-          capacity(other.capacity) {
-        for (std::size_t i = 0; i < lhs_size; ++i) {
-            lhs[i] = other.lhs[i];
-        }
+    constexpr TwinArray(const TwinArray& other)
+        : TwinArray(other, alloc_traits::select_on_container_copy_construction(other.alloc)) {}
 
-        for (std::size_t i = 0; i < rhs_size; ++i) {
-            rhs[i] = other.rhs[i];
-        }
+    constexpr TwinArray(const TwinArray& other, const Allocator& alloc)
+        : TwinArray(other.capacity, alloc) {
+        copy_elements_from(other);
+        growth = other.growth;
     }
 
     // Copy Assignment Operator
-    TwinArray& operator=(const TwinArray& other) {
+    constexpr TwinArray& operator=(const TwinArray& other) {
         if (this != &other) {
-            auto new_lhs = std::make_unique<T[]>(other.capacity);
-            auto new_rhs = std::make_unique<T[]>(other.capacity);
-
-            // Copy data from other
-            for (std::size_t i = 0; i < other.lhs_size; ++i) {
-                new_lhs[i] = other.lhs[i];
-            }
-            for (std::size_t i = 0; i < other.rhs_size; ++i) {
-                new_rhs[i] = other.rhs[i];
+            // Build the copy with whichever allocator we end up holding, then
+            // swap it in. The old storage leaves with the allocator that made it.
+            TwinArray tmp(other, pocca ? other.alloc : alloc);
+            swap_storage(tmp);
+            std::swap(alloc, tmp.alloc);
+            growth = other.growth;
+            if (journal) {
+                journal->clear();
             }
-
-            lhs = std::move(new_lhs);
-            rhs = std::move(new_rhs);
-            lhs_size = other.lhs_size;
-            rhs_size = other.rhs_size;
-            capacity = other.capacity;
         }
         return *this;
     }
 
     // Move Constructor
-    TwinArray(TwinArray&& other) noexcept
-        : lhs(std::move(other.lhs)),
-          rhs(std::move(other.rhs)),
-          lhs_size(other.lhs_size),
-          rhs_size(other.rhs_size),
-          capacity(other.capacity) {
-        // Reset other's state
-        other.lhs_size = 0;
-        other.rhs_size = 0;
-        other.capacity = 0;
+    constexpr TwinArray(TwinArray&& other) noexcept
+        : alloc(std::move(other.alloc)),
+          lhs(nullptr),
+          rhs(nullptr),
+          lhs_size(0),
+          rhs_size(0),
+          capacity(0),
+          growth(other.growth),
+          lines(make_line_index(alloc)),
+          journal(std::move(other.journal)) {
+        use_inline_storage();
+        take_storage(other);
+    }
+
+    // Storage can only be adopted when `alloc` is able to free it, otherwise
+    // the elements are copied into fresh storage.
+    constexpr TwinArray(TwinArray&& other, const Allocator& alloc)
+        : TwinArray(alloc == other.alloc ? 0 : other.capacity, alloc) {
+        if (this->alloc == other.alloc) {
+            swap_storage(other);
+        } else {
+            copy_elements_from(other);
+        }
+        growth = other.growth;
+        journal = std::move(other.journal);
     }
 
     // Move Assignment Operator
-    TwinArray& operator=(TwinArray&& other) noexcept {
+    constexpr TwinArray& operator=(TwinArray&& other) noexcept(
+        pocma || alloc_traits::is_always_equal::value) {
         if (this != &other) {
-            // Move resources
-            lhs = std::move(other.lhs);
-            rhs = std::move(other.rhs);
-            lhs_size = other.lhs_size;
-            rhs_size = other.rhs_size;
-            capacity = other.capacity;
-
-            other.lhs_size = 0;
-            other.rhs_size = 0;
-            other.capacity = 0;
+            // tmp takes the history along with the storage. It is handed over
+            // last, so a copy that throws leaves both histories in place.
+            if constexpr (pocma) {
+                TwinArray tmp(std::move(other));
+                swap_storage(tmp);
+                std::swap(alloc, tmp.alloc);
+                journal = std::move(tmp.journal);
+            } else {
+                TwinArray tmp(std::move(other), alloc);
+                swap_storage(tmp);
+                journal = std::move(tmp.journal);
+            }
+            growth = other.growth;
         }
         return *this;
     }
 
+    constexpr void swap(TwinArray& other) noexcept {
+        if constexpr (alloc_traits::propagate_on_container_swap::value) {
+            std::swap(alloc, other.alloc);
+        }
+        swap_storage(other);
+        std::swap(growth, other.growth);
+        std::swap(journal, other.journal);
+    }
+
+    friend constexpr void swap(TwinArray& a, TwinArray& b) noexcept { a.swap(b); }
+
+    [[nodiscard]] constexpr allocator_type get_allocator() const noexcept { return alloc; }
+
     // Destructor
-    ~TwinArray() = default;
+    constexpr ~TwinArray() { release(); }
 
     // Operator overloads
     friend std::ostream& operator<<(std::ostream& os, const TwinArray& buf) {
         os << "[";
-        for (auto i = 0; i < buf.lhs_size; i++) {
+        for (std::size_t i = 0; i < buf.lhs_size; i++) {
             os << buf.lhs[i] << " ";
         }
         os << "]";
 
         os << "[";
-        for (auto i = 0; i < buf.rhs_size; i++) {
-            os << buf.rhs[i] << " ";
+        for (std::size_t i = 0; i < buf.rhs_size; i++) {
+            os << buf.rhs_slot(i) << " ";
         }
         os << "]";
 
@@ -171,155 +942,2354 @@ class TwinArray {
     }
 
     // Modifiers
-    void push(const T& val) {
-        if (size() == capacity) {
-            resize(capacity * 2);
+    constexpr void push(const T& val) { emplace(val); }
+    constexpr void push(T&& val) { emplace(std::move(val)); }
+
+    // Construct an element in place before the cursor. Returns a reference
+    // to it.
+    template <typename... Args>
+    constexpr T& emplace(Args&&... args) {
+        if (lhs_size + rhs_size == capacity) {
+            // The arguments may refer to elements of this buffer, so the new
+            // element is built before the storage moves
+            T val(std::forward<Args>(args)...);
+            resize(next_capacity(capacity + 1));
+            return emplace_unchecked(std::move(val));
         }
-        lhs[lhs_size] = val;
-        lhs_size++;
+        return emplace_unchecked(std::forward<Args>(args)...);
     }
 
-    [[nodiscard]] std::optional<T> pop() {
-        if (size() == 0) {
+    // Remove the element before the cursor and move it out
+    [[nodiscard]] constexpr std::optional<T> pop() {
+        if (lhs_size == 0) {
             return {};
         }
 
-        T ret = lhs[lhs_size - 1];
-        lhs[lhs_size - 1] = T();
+        journal_edit([&](auto& j) {
+            j.record_erase_before(lhs_size, lhs + lhs_size - 1, lhs + lhs_size);
+        });
+        T ret = std::move(lhs[lhs_size - 1]);
+        if constexpr (is_text) {
+            if (ret == '\n') {
+                lines.lhs.pop_back();
+            }
+        }
+        destroy(lhs + lhs_size - 1);
         lhs_size--;
+        bump_stat([](TwinStats& stats) { stats.pops++; });
 
         return ret;
     }
 
-    void move_left() {
+    // Insert a whole range before the cursor, leaving the cursor after it.
+    // Sized ranges are checked against capacity and copied in one go.
+    template <std::ranges::input_range R>
+        requires std::convertible_to<std::ranges::range_reference_t<R>, const T&>
+    constexpr void insert(R&& range) {
+        if constexpr (std::ranges::sized_range<R>) {
+            const std::size_t count = std::ranges::size(range);
+            if (lhs_size + rhs_size + count > capacity) {
+                if constexpr (std::ranges::contiguous_range<R>) {
+                    if (may_alias(range)) {
+                        // Growing frees the storage the range points into, so
+                        // it is copied out first, like emplace() builds its
+                        // element
+                        insert(std::vector<T, Allocator>(
+                            std::ranges::begin(range), std::ranges::end(range), alloc));
+                        return;
+                    }
+                }
+                resize(next_capacity(lhs_size + rhs_size + count));
+            }
+            before_write_lhs(lhs_size, lhs_size + count);
+            T* end = construct_copies(
+                std::ranges::begin(range), std::ranges::end(range), lhs + lhs_size);
+            const std::size_t old_size = lhs_size;
+            lhs_size = end - lhs;
+            index_lines(old_size);
+            journal_edit([&](auto& j) { j.record_insert(old_size, lhs + old_size, end); });
+        } else {
+            for (auto&& val : range) {
+                push(val);
+            }
+        }
+    }
+
+    constexpr void insert(std::initializer_list<T> lst) {
+        insert(std::span<const T>(lst.begin(), lst.size()));
+    }
+
+    // Remove up to `count` elements before the cursor, like backspace.
+    // Returns how many were removed.
+    constexpr std::size_t erase_before(std::size_t count) {
+        count = std::min(count, lhs_size);
+        if (count > 0) {
+            journal_edit([&](auto& j) {
+                j.record_erase_before(lhs_size, lhs + lhs_size - count, lhs + lhs_size);
+            });
+        }
+        destroy(lhs + lhs_size - count, lhs + lhs_size);
+        lhs_size -= count;
+        if constexpr (is_text) {
+            while (!lines.lhs.empty() && lines.lhs.back() >= lhs_size) {
+                lines.lhs.pop_back();
+            }
+        }
+        return count;
+    }
+
+    // Remove up to `count` elements after the cursor, like forward delete.
+    // Returns how many were removed.
+    constexpr std::size_t erase_after(std::size_t count) {
+        count = std::min(count, rhs_size);
+        if (count > 0) {
+            journal_edit([&](auto& j) {
+                const auto after = std::as_const(*this).rhs_span();
+                j.record_erase_after(lhs_size, after.begin(), after.begin() + count);
+            });
+        }
+        for (std::size_t i = 0; i < count; i++) {
+            destroy(&rhs_slot(rhs_size - 1 - i));
+        }
+        rhs_size -= count;
+        if constexpr (is_text) {
+            while (!lines.rhs.empty() && lines.rhs.back() >= rhs_size) {
+                lines.rhs.pop_back();
+            }
+        }
+        return count;
+    }
+
+    constexpr void move_left() {
         if (lhs_size == 0) {
             return;
         }
 
-        rhs[rhs_size] = lhs[lhs_size - 1];
-        lhs[lhs_size - 1] = T();
+        if constexpr (is_text) {
+            if (lhs[lhs_size - 1] == '\n') {
+                lines.rhs.push_back(rhs_size);
+                lines.lhs.pop_back();
+            }
+        }
+        // A full gap buffer has no gap: the element already sits in its slot
+        if (!is_gap || lhs_size + rhs_size < capacity) {
+            before_write_rhs(rhs_size, rhs_size + 1);
+            construct(&rhs_slot(rhs_size), std::move(lhs[lhs_size - 1]));
+            destroy(lhs + lhs_size - 1);
+        }
         lhs_size--;
         rhs_size++;
+        bump_stat([](TwinStats& stats) { stats.cursor_moves++; });
     }
 
-    void move_right() {
+    constexpr void move_right() {
         if (rhs_size == 0) {
             return;
         }
 
-        lhs[lhs_size] = rhs[rhs_size - 1];
-        rhs[rhs_size - 1] = T();
+        if constexpr (is_text) {
+            if (rhs_slot(rhs_size - 1) == '\n') {
+                lines.lhs.push_back(lhs_size);
+                lines.rhs.pop_back();
+            }
+        }
+        if (!is_gap || lhs_size + rhs_size < capacity) {
+            before_write_lhs(lhs_size, lhs_size + 1);
+            construct(lhs + lhs_size, std::move(rhs_slot(rhs_size - 1)));
+            destroy(&rhs_slot(rhs_size - 1));
+        }
         lhs_size++;
         rhs_size--;
+        bump_stat([](TwinStats& stats) { stats.cursor_moves++; });
     }
 
-    // Element Access
-    [[nodiscard]] T at(const std::size_t idx) const {
-        if (idx >= size()) {
+    // Move the cursor so that `pos` elements sit to the left of it. The span
+    // between the old and new cursor is transferred in one block rather than
+    // one element at a time.
+    constexpr void move_to(const std::size_t pos) {
+        if (pos > lhs_size + rhs_size) {
             throw std::out_of_range("index out of range");
         }
 
-        if (idx < lhs_size) {
-            return lhs[idx];
-        } else if (idx < size()) {
-            auto rhs_view =
-                std::views::reverse(std::ranges::subrange(rhs.get(), rhs.get() + rhs_size));
-
-            return rhs_view[idx - lhs_size];
+        if (!std::is_trivially_copyable_v<T> || std::is_constant_evaluated()) {
+            // Every element needs its own move and destroy anyway, so there
+            // is no block transfer to be had. Constant evaluation has to
+            // construct each slot it writes as well.
+            while (lhs_size > pos) {
+                move_left();
+            }
+            while (lhs_size < pos) {
+                move_right();
+            }
+        } else if constexpr (std::is_trivially_copyable_v<T>) {
+            // A full gap buffer has no gap: the span already sits in its
+            // slots, and copying it onto itself would break the preconditions
+            // of std::copy and std::copy_backward
+            const bool gapless = is_gap && lhs_size + rhs_size == capacity;
+            if (pos < lhs_size) {
+                const std::size_t count = lhs_size - pos;
+                if constexpr (is_text) {
+                    transfer_breaks(lines.lhs, lines.rhs, pos, rhs_size + lhs_size - 1);
+                }
+                if (!gapless) {
+                    before_write_rhs(rhs_size, rhs_size + count);
+                    // Both halves are in logical order, so the span moves as
+                    // one block. With the gap layout the regions overlap when
+                    // the gap is smaller than the span.
+                    std::copy_backward(lhs + pos, lhs + lhs_size, rhs_storage());
+                }
+                lhs_size -= count;
+                rhs_size += count;
+                bump_stat([&](TwinStats& stats) { stats.cursor_moves += count; });
+            } else if (pos > lhs_size) {
+                const std::size_t count = pos - lhs_size;
+                if constexpr (is_text) {
+                    transfer_breaks(
+                        lines.rhs, lines.lhs, rhs_size - count, lhs_size + rhs_size - 1);
+                }
+                if (!gapless) {
+                    before_write_lhs(lhs_size, pos);
+                    std::copy(rhs_storage(), rhs_storage() + count, lhs + lhs_size);
+                }
+                lhs_size += count;
+                rhs_size -= count;
+                bump_stat([&](TwinStats& stats) { stats.cursor_moves += count; });
+            }
         }
     }
 
-    [[nodiscard]] T peek() const { return lhs[lhs_size - 1]; }
-
-    // Capacity
-    [[nodiscard]] int size() const noexcept { return lhs_size + rhs_size; }
-    [[nodiscard]] int total_capacity() const noexcept { return capacity; }
-    [[nodiscard]] bool empty() const noexcept { return size() == 0; }
-
-    void resize(const std::size_t new_cap) {
-        auto new_lhs = std::make_unique<T[]>(new_cap);
-        auto new_rhs = std::make_unique<T[]>(new_cap);
+    // Relative version of move_to(). Like move_left()/move_right(), the cursor
+    // stops at either end of the buffer instead of throwing.
+    constexpr void move_by(const std::ptrdiff_t offset) {
+        if (offset < 0) {
+            const std::size_t dist = static_cast<std::size_t>(-offset);
+            move_to(dist > lhs_size ? 0 : lhs_size - dist);
+        } else {
+            move_to(lhs_size + std::min(static_cast<std::size_t>(offset), rhs_size));
+        }
+    }
 
-        for (std::size_t i = 0; i < lhs_size; i++) {
-            new_lhs[i] = lhs[i];
+    // Snapshots
+    // A read-only copy of the current contents that costs nothing up front.
+    // It shares this buffer's storage: before an edit overwrites elements a
+    // snapshot can still see, the chunk holding them is copied aside, and a
+    // resize leaves the old storage to the snapshots. Snapshots can be read
+    // from any thread while this buffer is edited, but the buffer itself is
+    // still single-threaded. References, iterators and spans taken before
+    // snapshot() must not be written through afterwards.
+    [[nodiscard]] TwinSnapshot<T> snapshot()
+        requires(snapshottable)
+    {
+        if (is_inline()) {
+            // Inline storage moves with the object, so the view gets a copy
+            const auto copy = std::make_shared_for_overwrite<T[]>(size());
+            std::copy(cbegin(), cend(), copy.get());
+            return TwinSnapshot<T>(std::make_shared<twin_array_detail::FrozenView<T>>(
+                copy, copy.get(), nullptr, size(), size(), 0));
         }
 
-        for (std::size_t i = 0; i < rhs_size; i++) {
-            new_rhs[i] = rhs[i];
+        if (!sharing) {
+            auto state = twin_array_detail::Owned<Sharing>(new Sharing());
+            // Disarmed until constructed, a throwing shared_ptr frees its pointer
+            state->block = std::shared_ptr<T>(lhs, BlockDeleter {alloc, rhs, capacity, false});
+            std::get_deleter<BlockDeleter>(state->block)->armed = true;
+            sharing = std::move(state);
         }
 
-        lhs = std::move(new_lhs);
-        rhs = std::move(new_rhs);
-        capacity = new_cap;
+        auto view = std::make_shared<twin_array_detail::FrozenView<T>>(
+            sharing->block, lhs, is_gap ? nullptr : rhs, capacity, lhs_size, rhs_size);
+        for_each_view([](const auto&) {});
+        sharing->views.push_back(view);
+        sharing->frozen_lhs = std::max(sharing->frozen_lhs, lhs_size);
+        sharing->frozen_rhs = std::max(sharing->frozen_rhs, rhs_size);
+        return TwinSnapshot<T>(std::move(view));
     }
 
-    // Char-only methods
-    [[nodiscard]] std::string to_str() const noexcept
-        requires(std::is_same_v<T, char>)
+    // Undo history
+    // Once enabled, edits are recorded as they happen. Runs of pushes, pops
+    // and erases at the cursor merge into single insert or delete records,
+    // so memory grows with the edits rather than the size of the buffer.
+    // Cursor moves are not recorded. The history is not copied with the
+    // buffer and is cleared when the buffer is assigned to. Only available
+    // for copyable elements, since the history keeps copies of them.
+    void enable_journal()
+        requires(std::is_copy_constructible_v<T>)
     {
-        std::string ret;
-        std::for_each(lhs.get(), lhs.get() + lhs_size, [&](const char& c) { ret.push_back(c); });
+        if (!journal) {
+            journal = twin_array_detail::Owned<Journal>(new Journal(alloc));
+        }
+    }
 
-        auto rhs_view = std::views::reverse(std::ranges::subrange(rhs.get(), rhs.get() + rhs_size));
+    void disable_journal() noexcept { journal.reset(); }
 
-        std::for_each(rhs_view.begin(), rhs_view.end(), [&](const char& c) { ret.push_back(c); });
+    [[nodiscard]] constexpr bool journal_enabled() const noexcept {
+        return static_cast<bool>(journal);
+    }
+
+    [[nodiscard]] constexpr bool can_undo() const noexcept {
+        return journal && journal->applied > 0;
+    }
+
+    [[nodiscard]] constexpr bool can_redo() const noexcept {
+        return journal && journal->applied < journal->records.size();
+    }
+
+    // Revert the last edit or transaction, leaving the cursor where it took
+    // place. Returns false if there is nothing to undo. Throws
+    // std::logic_error inside a transaction.
+    bool undo()
+        requires(std::is_copy_constructible_v<T>)
+    {
+        if (!can_undo()) {
+            return false;
+        }
+        if (journal->depth > 0) {
+            throw std::logic_error("undo inside a transaction");
+        }
+
+        Journal& j = *journal;
+        j.replaying = true;
+        const std::size_t group = j.records[j.applied - 1].group;
+        try {
+            while (j.applied > 0 && j.records[j.applied - 1].group == group) {
+                revert(j.records[j.applied - 1]);
+                j.applied--;
+            }
+        } catch (...) {
+            j.replaying = false;
+            throw;
+        }
+        j.replaying = false;
+        j.sealed = true;
+        return true;
+    }
+
+    // Reapply the last undone edit or transaction. Returns false if there is
+    // nothing to redo.
+    bool redo()
+        requires(std::is_copy_constructible_v<T>)
+    {
+        if (!can_redo()) {
+            return false;
+        }
+        if (journal->depth > 0) {
+            throw std::logic_error("redo inside a transaction");
+        }
+
+        Journal& j = *journal;
+        j.replaying = true;
+        const std::size_t group = j.records[j.applied].group;
+        try {
+            while (j.applied < j.records.size() && j.records[j.applied].group == group) {
+                reapply(j.records[j.applied]);
+                j.applied++;
+            }
+        } catch (...) {
+            j.replaying = false;
+            throw;
+        }
+        j.replaying = false;
+        j.sealed = true;
+        return true;
+    }
+
+    // Edits between begin_transaction() and the matching end_transaction()
+    // are undone and redone as one step. Transactions may nest; only the
+    // outermost one counts. Both are no-ops while the journal is disabled.
+    constexpr void begin_transaction() noexcept {
+        if (journal && journal->depth++ == 0) {
+            journal->open_group = journal->next_group++;
+            journal->sealed = true;
+        }
+    }
+
+    constexpr void end_transaction() {
+        if (!journal) {
+            return;
+        }
+        if (journal->depth == 0) {
+            throw std::logic_error("no transaction to end");
+        }
+        if (--journal->depth == 0) {
+            journal->sealed = true;
+        }
+    }
+
+    // Iterators
+    // Iterators walk the buffer in logical order, hiding the split. Prefer
+    // segments() in hot loops, it avoids checking which half each element
+    // lives in.
+    // The non-const versions give up sharing storage with snapshots.
+    // TwinArray<char> only hands out const iterators, since writes through
+    // them would go around the line index.
+    [[nodiscard]] constexpr iterator begin()
+        requires(!std::is_same_v<T, char>)
+    {
+        unshare();
+        return iterator(this, 0);
+    }
+    [[nodiscard]] constexpr iterator end()
+        requires(!std::is_same_v<T, char>)
+    {
+        unshare();
+        return iterator(this, size());
+    }
+    [[nodiscard]] constexpr const_iterator begin() const noexcept {
+        return const_iterator(this, 0);
+    }
+    [[nodiscard]] constexpr const_iterator end() const noexcept {
+        return const_iterator(this, size());
+    }
+    [[nodiscard]] constexpr const_iterator cbegin() const noexcept { return begin(); }
+    [[nodiscard]] constexpr const_iterator cend() const noexcept { return end(); }
+    [[nodiscard]] constexpr reverse_iterator rbegin()
+        requires(!std::is_same_v<T, char>)
+    {
+        return reverse_iterator(end());
+    }
+    [[nodiscard]] constexpr reverse_iterator rend()
+        requires(!std::is_same_v<T, char>)
+    {
+        return reverse_iterator(begin());
+    }
+    [[nodiscard]] constexpr const_reverse_iterator rbegin() const noexcept {
+        return const_reverse_iterator(end());
+    }
+    [[nodiscard]] constexpr const_reverse_iterator rend() const noexcept {
+        return const_reverse_iterator(begin());
+    }
+    [[nodiscard]] constexpr const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+    [[nodiscard]] constexpr const_reverse_iterator crend() const noexcept { return rend(); }
+
+    // Both halves as contiguous spans in logical order: the elements before
+    // the cursor, then the elements after it.
+    [[nodiscard]] constexpr auto segments()
+        requires(!std::is_same_v<T, char>)
+    {
+        return std::pair {lhs_span(), rhs_span()};
+    }
+    [[nodiscard]] constexpr auto segments() const noexcept {
+        return std::pair {lhs_span(), rhs_span()};
+    }
+
+    // Element Access
+    [[nodiscard]] constexpr T at(const std::size_t idx) const {
+        if (idx >= size()) {
+            throw std::out_of_range("index out of range");
+        }
+
+        bump_stat([&](TwinStats& stats) {
+            (idx < lhs_size ? stats.lhs_reads : stats.rhs_reads)++;
+        });
+        return element(idx);
+    }
+
+    [[nodiscard]] constexpr T peek() const { return lhs_size == 0 ? T() : lhs[lhs_size - 1]; }
+
+    // Unchecked access for hot loops. Indices must be in range and the
+    // element must exist: front() and back() need a non-empty buffer,
+    // before_cursor() an element before the cursor and after_cursor() one
+    // after it.
+    // The non-const versions give up sharing storage with snapshots, and
+    // writes through them are not seen by the undo history. Each call checks
+    // for snapshots first; loops writing many elements should take the half
+    // spans or segments() instead, which detach once up front. TwinArray<char>
+    // only has the const versions, so its line index can't go stale.
+    [[nodiscard]] constexpr const_reference operator[](const std::size_t idx) const noexcept {
+        return element(idx);
+    }
+    [[nodiscard]] constexpr reference operator[](const std::size_t idx)
+        requires(!std::is_same_v<T, char>)
+    {
+        unshare();
+        return element(idx);
+    }
+
+    [[nodiscard]] constexpr const_reference front() const noexcept { return element(0); }
+    [[nodiscard]] constexpr reference front()
+        requires(!std::is_same_v<T, char>)
+    {
+        unshare();
+        return element(0);
+    }
+    [[nodiscard]] constexpr const_reference back() const noexcept { return element(size() - 1); }
+    [[nodiscard]] constexpr reference back()
+        requires(!std::is_same_v<T, char>)
+    {
+        unshare();
+        return element(size() - 1);
+    }
 
+    [[nodiscard]] constexpr const_reference before_cursor() const noexcept {
+        return lhs[lhs_size - 1];
+    }
+    [[nodiscard]] constexpr reference before_cursor()
+        requires(!std::is_same_v<T, char>)
+    {
+        unshare();
+        return lhs[lhs_size - 1];
+    }
+    [[nodiscard]] constexpr const_reference after_cursor() const noexcept {
+        return rhs_storage()[0];
+    }
+    [[nodiscard]] constexpr reference after_cursor()
+        requires(!std::is_same_v<T, char>)
+    {
+        unshare();
+        return rhs_storage()[0];
+    }
+
+    // Each half as a contiguous span. Taking a mutable span gives up sharing
+    // storage with snapshots, so writes through it cost nothing extra.
+    [[nodiscard]] constexpr std::span<const T> lhs_span() const noexcept { return {lhs, lhs_size}; }
+    [[nodiscard]] constexpr std::span<T> lhs_span()
+        requires(!std::is_same_v<T, char>)
+    {
+        unshare();
+        return {lhs, lhs_size};
+    }
+    [[nodiscard]] constexpr std::span<const T> rhs_span() const noexcept {
+        return {rhs_storage(), rhs_size};
+    }
+    [[nodiscard]] constexpr std::span<T> rhs_span()
+        requires(!std::is_same_v<T, char>)
+    {
+        unshare();
+        return {rhs_storage(), rhs_size};
+    }
+
+    // Capacity
+    [[nodiscard]] constexpr int size() const noexcept { return lhs_size + rhs_size; }
+    [[nodiscard]] constexpr int total_capacity() const noexcept { return capacity; }
+    [[nodiscard]] constexpr bool empty() const noexcept { return size() == 0; }
+
+    constexpr void resize(const std::size_t new_cap) {
+        if (new_cap < lhs_size + rhs_size) {
+            throw std::length_error("capacity smaller than size");
+        }
+
+        // Inline storage always keeps its full capacity
+        if (is_inline() && new_cap <= InlineCapacity) {
+            return;
+        }
+        note_peak_capacity();
+        bump_stat([&](TwinStats& stats) {
+            stats.resizes++;
+            stats.bytes_copied += (lhs_size + rhs_size) * sizeof(T);
+        });
+
+        if constexpr (reallocatable) {
+            if (!std::is_constant_evaluated() && !is_inline() && new_cap > InlineCapacity &&
+                storage_exclusive()) {
+                reallocate(new_cap);
+                return;
+            }
+        }
+
+        TwinArray tmp(new_cap, alloc);
+        tmp.relocate_elements_from(*this);
+        swap_storage(tmp);
+    }
+
+    constexpr void reserve(const std::size_t new_cap) {
+        if (new_cap > capacity) {
+            resize(new_cap);
+        }
+    }
+
+    constexpr void shrink_to_fit() {
+        if (capacity > lhs_size + rhs_size) {
+            resize(lhs_size + rhs_size);
+        }
+    }
+
+    [[nodiscard]] constexpr TwinGrowth growth_policy() const noexcept { return growth; }
+
+    constexpr void set_growth_policy(const TwinGrowth policy) {
+        if (!(policy.factor > 1.0) || policy.max_step == 0) {
+            throw std::invalid_argument("growth policy must increase capacity");
+        }
+        growth = policy;
+    }
+
+#ifdef TWIN_ARRAY_STATS
+    // Counters since construction or the last reset_stats(). They belong to
+    // this object and are not copied, moved or swapped with the contents.
+    [[nodiscard]] TwinStats stats() const noexcept {
+        TwinStats ret = counters;
+        ret.peak_capacity = std::max(ret.peak_capacity, capacity);
         return ret;
     }
 
-    [[nodiscard]] std::string get_current_line() const noexcept
+    void reset_stats() noexcept { counters = TwinStats{.peak_capacity = capacity}; }
+#endif
+
+    // Char-only methods
+    [[nodiscard]] constexpr std::string to_str() const noexcept
         requires(std::is_same_v<T, char>)
     {
         std::string ret;
-        int last_idx = std::string_view(lhs.get()).find_last_of('\n');
-        if (last_idx > lhs_size) {
-            last_idx = 0;
+        ret.reserve(lhs_size + rhs_size);
+        ret.append(lhs, lhs_size);
+        ret.append(rhs_storage(), rhs_size);
+
+        return ret;
+    }
+
+    // Write the contents out without building an intermediate string
+    std::ostream& write_to(std::ostream& os) const
+        requires(std::is_same_v<T, char>)
+    {
+        for_each_chunk([&](const char* data, const std::size_t len) {
+            os.write(data, static_cast<std::streamsize>(len));
+        });
+        return os;
+    }
+
+#ifdef TWIN_ARRAY_POSIX
+    // Throws std::system_error if the write fails
+    void write_to(const int fd) const
+        requires(std::is_same_v<T, char>)
+    {
+        iovec iov[2] = {
+            {const_cast<char*>(lhs), lhs_size},
+            {const_cast<char*>(rhs_storage()), rhs_size},
+        };
+        write_fully(fd, iov, 2);
+    }
+
+    // Load a file straight into lhs with the cursor at the end. Regular files
+    // are mapped and copied over in one pass; anything mmap() refuses (pipes,
+    // /proc) is read() in directly. Throws std::system_error on failure.
+    [[nodiscard]] static TwinArray from_file(const char* path, const Allocator& alloc = Allocator())
+        requires(std::is_same_v<T, char>)
+    {
+        const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open");
+        }
+        struct Closer {
+            int fd;
+            ~Closer() { ::close(fd); }
+        } closer {fd};
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0) {
+            throw std::system_error(errno, std::generic_category(), "fstat");
+        }
+
+        if (S_ISREG(st.st_mode) && st.st_size > 0) {
+            const auto len = static_cast<std::size_t>(st.st_size);
+            void* map = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                ::madvise(map, len, MADV_SEQUENTIAL);
+                try {
+                    TwinArray ret(len + 8, alloc);
+                    std::memcpy(ret.lhs, map, len);
+                    ret.lhs_size = len;
+                    ret.index_lines(0);
+                    ::munmap(map, len);
+                    return ret;
+                } catch (...) {
+                    ::munmap(map, len);
+                    throw;
+                }
+            }
+        }
+
+        TwinArray ret(S_ISREG(st.st_mode) ? static_cast<std::size_t>(st.st_size) + 8 : 4096, alloc);
+        ret.read_fully(fd);
+        return ret;
+    }
+
+    [[nodiscard]] static TwinArray from_file(const std::string& path,
+                                             const Allocator& alloc = Allocator())
+        requires(std::is_same_v<T, char>)
+    {
+        return from_file(path.c_str(), alloc);
+    }
+#endif
+
+    [[nodiscard]] constexpr std::string get_current_line() const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        return line(curr_line_index());
+    }
+
+    [[nodiscard]] constexpr char get_current_char() const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        return lhs_size == 0 ? '\0' : lhs[lhs_size - 1];
+    }
+
+    // Line numbers start at 1. Line breaks are indexed as the buffer is
+    // edited, so none of the line queries scan the text.
+    [[nodiscard]] constexpr int curr_line_index() const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        return lines.lhs.size() + 1;
+    }
+
+    [[nodiscard]] constexpr int curr_char_index() const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        const std::size_t last_idx = lines.lhs.empty() ? 0 : lines.lhs.back();
+        return (lhs_size - last_idx) - 1;
+    }
+
+    [[nodiscard]] constexpr std::size_t line_count() const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        return lines.lhs.size() + lines.rhs.size() + 1;
+    }
+
+    // Index of the first character of line n
+    [[nodiscard]] constexpr std::size_t line_start(const std::size_t n) const
+        requires(std::is_same_v<T, char>)
+    {
+        if (n == 0 || n > line_count()) {
+            throw std::out_of_range("line out of range");
+        }
+
+        // The line starts after the (n - 1)th line break
+        const std::size_t breaks = n - 1;
+        if (breaks == 0) {
+            return 0;
+        } else if (breaks <= lines.lhs.size()) {
+            return lines.lhs[breaks - 1] + 1;
+        }
+
+        const std::size_t slot = lines.rhs[lines.rhs.size() - (breaks - lines.lhs.size())];
+        return lhs_size + (rhs_size - 1 - slot) + 1;
+    }
+
+    // Occurrences of c anywhere in the buffer
+    [[nodiscard]] constexpr std::size_t count(const char c) const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        const auto count = twin_array_detail::kernels().count;
+        return count(lhs, lhs_size, c) + count(rhs_storage(), rhs_size, c);
+    }
+
+    // Index of the first c after the cursor, or npos
+    [[nodiscard]] constexpr std::size_t find_next(const char c) const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        return find_byte(c, lhs_size, lhs_size + rhs_size);
+    }
+
+    // Index of the last c before the cursor, or npos
+    [[nodiscard]] constexpr std::size_t find_prev(const char c) const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        return rfind_byte(c, lhs_size);
+    }
+
+    // Substring search straight over both halves, without building a string
+    // first. Matches may span the cursor. Candidates are found with the byte
+    // kernels on the needle's first character and then verified in place.
+
+    // Index of the first match starting at or after `from`, or npos
+    [[nodiscard]] constexpr std::size_t find(
+        const std::string_view needle, const std::size_t from = 0) const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        const std::size_t len = lhs_size + rhs_size;
+        if (needle.size() > len || from > len - needle.size()) {
+            return npos;
+        } else if (needle.empty()) {
+            return from;
         }
 
-        for (int i = last_idx; i < lhs_size; i++) {
-            ret.push_back(lhs[i]);
+        const std::size_t last_start = len - needle.size();
+        for (std::size_t pos = find_byte(needle[0], from, last_start + 1); pos != npos;
+             pos = find_byte(needle[0], pos + 1, last_start + 1)) {
+            if (matches_at(pos, needle)) {
+                return pos;
+            }
+        }
+        return npos;
+    }
+
+    // Index of the last match starting at or before `from`, or npos
+    [[nodiscard]] constexpr std::size_t rfind(
+        const std::string_view needle, const std::size_t from = npos) const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        const std::size_t len = lhs_size + rhs_size;
+        if (needle.size() > len) {
+            return npos;
         }
 
-        if (lhs[lhs_size - 1] != '\n') {
-            int rhs_idx = rhs_size - 1;
+        const std::size_t last_start = std::min(from, len - needle.size());
+        if (needle.empty()) {
+            return last_start;
+        }
 
-            while (rhs[rhs_idx] != '\n' || rhs_idx > 0) {
-                ret.push_back(rhs[rhs_idx]);
-                rhs_idx--;
+        for (std::size_t pos = rfind_byte(needle[0], last_start + 1); pos != npos;
+             pos = pos == 0 ? npos : rfind_byte(needle[0], pos)) {
+            if (matches_at(pos, needle)) {
+                return pos;
             }
         }
+        return npos;
+    }
+
+    // Start of every non-overlapping match, in order
+    [[nodiscard]] constexpr std::vector<std::size_t> find_all(const std::string_view needle) const
+        requires(std::is_same_v<T, char>)
+    {
+        std::vector<std::size_t> ret;
+        if (needle.empty()) {
+            return ret;
+        }
 
+        for (std::size_t pos = find(needle); pos != npos; pos = find(needle, pos + needle.size())) {
+            ret.push_back(pos);
+        }
         return ret;
     }
 
-    [[nodiscard]] char get_current_char() const noexcept
+    // Contents of line n, without its line break
+    [[nodiscard]] constexpr std::string line(const std::size_t n) const
         requires(std::is_same_v<T, char>)
     {
-        return lhs[lhs_size - 1];
+        const std::size_t start = line_start(n);
+        const std::size_t end = n == line_count() ? lhs_size + rhs_size : line_start(n + 1) - 1;
+        return std::string(begin() + start, begin() + end);
+    }
+
+    // UTF-8
+    // The text is treated as UTF-8, with every byte that is not part of a
+    // valid sequence standing alone. Runs of ASCII take a fast path, so
+    // plain ASCII text costs about as much as counting bytes.
+    constexpr void move_left(const TwinUnit unit)
+        requires(std::is_same_v<T, char>)
+    {
+        if (lhs_size == 0) {
+            return;
+        }
+
+        // An ASCII char is a code point of its own, and a cluster unless it
+        // is the '\n' of a "\r\n"
+        const char c = lhs[lhs_size - 1];
+        if (unit == TwinUnit::byte || (static_cast<unsigned char>(c) < 0x80 &&
+                                       (unit == TwinUnit::codepoint || c != '\n'))) {
+            move_left();
+            return;
+        }
+        move_to(unit == TwinUnit::codepoint ? codepoint_start_before(lhs_size)
+                                            : grapheme_start_before(lhs_size));
     }
 
-    [[nodiscard]] int curr_line_index() const noexcept
+    constexpr void move_right(const TwinUnit unit)
         requires(std::is_same_v<T, char>)
     {
-        return std::count(lhs.get(), lhs.get() + lhs_size, '\n') + 1;
+        if (rhs_size == 0) {
+            return;
+        }
+
+        // Nothing ASCII extends a cluster, so an ASCII char followed by
+        // another one is a whole cluster unless they are "\r\n"
+        const char c = rhs_slot(rhs_size - 1);
+        const bool ascii = static_cast<unsigned char>(c) < 0x80;
+        if (unit == TwinUnit::byte || (ascii && unit == TwinUnit::codepoint) ||
+            (ascii && c != '\r' &&
+             (rhs_size == 1 || static_cast<unsigned char>(rhs_slot(rhs_size - 2)) < 0x80))) {
+            move_right();
+            return;
+        }
+        move_to(unit == TwinUnit::codepoint ? lhs_size + decode_at(lhs_size).len
+                                            : grapheme_end(lhs_size));
     }
 
-    [[nodiscard]] int curr_char_index() const noexcept
+    // Position of the cursor in its line, from 0, counted in `unit`s. Unlike
+    // curr_char_index() this scans the line up to the cursor.
+    [[nodiscard]] constexpr std::size_t column(const TwinUnit unit) const noexcept
         requires(std::is_same_v<T, char>)
     {
-        auto last_idx = std::string_view(lhs.get()).find_last_of('\n');
-        if (last_idx > lhs_size) {
-            last_idx = 0;
+        const std::size_t start = lines.lhs.empty() ? 0 : lines.lhs.back() + 1;
+        if (unit == TwinUnit::byte) {
+            return lhs_size - start;
         }
-        return (lhs_size - last_idx) - 1;
+
+        // Everything between the line start and the cursor is in lhs
+        const auto ascii = twin_array_detail::kernels().ascii;
+        twin_array_detail::GraphemeBreaks breaks;
+        std::size_t col = 0;
+        std::size_t pos = start;
+        while (pos < lhs_size) {
+            // Each ASCII char is a code point and, short of a "\r\n" which
+            // cannot come before the cursor on its line, a cluster
+            const std::size_t run = ascii(lhs + pos, lhs_size - pos);
+            if (run > 0) {
+                col += run;
+                pos += run;
+                breaks = {static_cast<unsigned char>(lhs[pos - 1]), 0, true};
+                continue;
+            }
+
+            const auto ch = decode_at(pos);
+            if (unit == TwinUnit::codepoint || breaks.starts_cluster(ch.cp)) {
+                col++;
+            }
+            pos += ch.len;
+        }
+        return col;
+    }
+
+    // Terminal cell the cursor sits in, from 0. Wide characters take two
+    // cells, combining marks none and tabs advance to the next multiple of
+    // tab_width. A cluster is as wide as its first code point, or two cells
+    // when it asks for emoji presentation.
+    [[nodiscard]] constexpr std::size_t display_column(const std::size_t tab_width = 8) const
+        noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        const auto& kernels = twin_array_detail::kernels();
+        const std::size_t start = lines.lhs.empty() ? 0 : lines.lhs.back() + 1;
+        const auto tab = [&](const std::size_t col) {
+            return tab_width == 0 ? col : (col / tab_width + 1) * tab_width;
+        };
+
+        twin_array_detail::GraphemeBreaks breaks;
+        std::size_t col = 0;
+        std::size_t cluster_width = 0;
+        std::size_t pos = start;
+        while (pos < lhs_size) {
+            std::size_t run = kernels.ascii(lhs + pos, lhs_size - pos);
+            if (run > 0) {
+                const char* const end = lhs + pos + run;
+                const char* it = lhs + pos;
+                for (const char* t = kernels.find(it, run, '\t'); t != nullptr;
+                     t = kernels.find(it, end - it, '\t')) {
+                    col = tab(col + (t - it));
+                    it = t + 1;
+                }
+                col += end - it;
+                pos += run;
+                cluster_width = 1;
+                breaks = {static_cast<unsigned char>(lhs[pos - 1]), 0, true};
+                continue;
+            }
+
+            const auto ch = decode_at(pos);
+            if (breaks.starts_cluster(ch.cp)) {
+                cluster_width = twin_array_detail::display_width(ch.cp);
+                col += cluster_width;
+            } else if (ch.cp == 0xFE0F && cluster_width == 1) {
+                cluster_width = 2;
+                col++;
+            }
+            pos += ch.len;
+        }
+        return col;
+    }
+
+    // Index of the first byte that is not part of well-formed UTF-8, or npos
+    [[nodiscard]] constexpr std::size_t find_invalid_utf8() const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        const auto ascii = twin_array_detail::kernels().ascii;
+        const std::size_t len = lhs_size + rhs_size;
+        std::size_t pos = 0;
+        while (pos < len) {
+            if (pos < lhs_size) {
+                pos += ascii(lhs + pos, lhs_size - pos);
+            } else {
+                pos += ascii(rhs_storage() + (pos - lhs_size), len - pos);
+            }
+            // A run stops at the cursor as well as at the first non-ASCII byte
+            if (pos == len || static_cast<unsigned char>(element(pos)) < 0x80) {
+                continue;
+            }
+
+            const auto ch = decode_at(pos);
+            if (!ch.valid) {
+                return pos;
+            }
+            pos += ch.len;
+        }
+        return npos;
+    }
+
+    [[nodiscard]] constexpr bool valid_utf8() const noexcept
+        requires(std::is_same_v<T, char>)
+    {
+        return find_invalid_utf8() == npos;
     }
 
    private:
-    std::unique_ptr<T[]> lhs;
-    std::unique_ptr<T[]> rhs;  // NOTE: rhs is stored backwards
-    std::size_t lhs_size;
-    std::size_t rhs_size;
-    std::size_t capacity;
-};
+    static constexpr bool is_gap = Layout == TwinLayout::gap;
+    static constexpr bool is_text = std::is_same_v<T, char>;
+
+    using break_list =
+        std::vector<std::size_t, typename alloc_traits::template rebind_alloc<std::size_t>>;
+
+    // Positions of every '\n' in the buffer, kept in step with each edit.
+    // lhs holds indices into lhs and rhs holds rhs slots, both ascending, so
+    // the breaks nearest the cursor sit at the back of each list.
+    struct LineIndex {
+        break_list lhs;
+        break_list rhs;
+    };
+
+    struct NoLineIndex {};
+
+    // Raw storage for the inline elements, one run per half
+    template <std::size_t Count>
+    struct InlineStorage {
+        alignas(T) std::byte bytes[Count * sizeof(T)];
+
+        T* data() noexcept { return std::launder(reinterpret_cast<T*>(bytes)); }
+        const T* data() const noexcept { return std::launder(reinterpret_cast<const T*>(bytes)); }
+    };
+
+    struct NoInlineStorage {};
+
+    // Frees storage that snapshots may still be reading, see release()
+    struct BlockDeleter {
+        Allocator alloc;
+        T* rhs;
+        std::size_t capacity;
+        bool armed;
+
+        void operator()(T* lhs) noexcept {
+            if (armed) {
+                deallocate(alloc, lhs, capacity);
+                deallocate(alloc, rhs, capacity);
+            }
+        }
+    };
+
+    // Set up by the first snapshot() of a block of storage, which from then on
+    // belongs to `block`. The frozen extents are the largest lhs and rhs any
+    // live view holds, so writes outside them need no checks.
+    struct Sharing {
+        std::shared_ptr<T> block;
+        std::vector<std::weak_ptr<twin_array_detail::FrozenView<T>>> views;
+        std::size_t frozen_lhs = 0;
+        std::size_t frozen_rhs = 0;
+    };
+
+    // One entry in the undo history. The elements live in a run of
+    // Journal::data; erase_before runs are stored back to front so that
+    // further backspaces can append to them.
+    struct JournalRecord {
+        enum Kind : unsigned char { insert, erase_before, erase_after };
+
+        Kind kind;
+        std::size_t pos;  // Logical index of the first element
+        std::size_t offset;
+        std::size_t count;
+        std::size_t group;
+    };
+
+    // Records are kept in edit order, so only the last one ever grows and its
+    // run is always at the end of `data`. [0, applied) are done, the rest
+    // can be redone until the next edit drops them.
+    struct Journal {
+        using record_list =
+            std::vector<JournalRecord, typename alloc_traits::template rebind_alloc<JournalRecord>>;
+
+        record_list records;
+        std::vector<T, Allocator> data;
+        std::size_t applied = 0;
+        std::size_t depth = 0;
+        std::size_t next_group = 0;
+        std::size_t open_group = 0;
+        bool sealed = true;  // Whether the next edit has to start a new record
+        bool replaying = false;
+
+        explicit Journal(const Allocator& alloc)
+            : records(typename record_list::allocator_type(alloc)), data(alloc) {}
+
+        void clear() noexcept {
+            records.clear();
+            data.clear();
+            applied = 0;
+            sealed = true;
+        }
+
+        // [first, last) was inserted at pos
+        template <typename It>
+        void record_insert(const std::size_t pos, It first, It last) {
+            if (replaying) {
+                return;
+            }
+            drop_redo();
+
+            JournalRecord* rec = mergeable();
+            if (rec != nullptr && rec->kind == JournalRecord::insert &&
+                rec->pos + rec->count == pos) {
+                data.insert(data.end(), first, last);
+                rec->count += last - first;
+                return;
+            }
+            add(JournalRecord::insert, pos, first, last);
+        }
+
+        // [first, last) is about to be removed from just before the cursor
+        template <typename It>
+        void record_erase_before(std::size_t cursor, It first, It last) {
+            if (replaying) {
+                return;
+            }
+            drop_redo();
+
+            JournalRecord* rec = mergeable();
+            if (rec != nullptr && rec->kind == JournalRecord::insert &&
+                rec->pos + rec->count == cursor) {
+                // Deleting what was just inserted shrinks the insert instead
+                const std::size_t undone =
+                    std::min<std::size_t>(last - first, rec->count);
+                data.erase(data.end() - undone, data.end());
+                rec->count -= undone;
+                if (rec->count == 0) {
+                    records.pop_back();
+                    applied--;
+                }
+                last -= undone;
+                cursor -= undone;
+                if (first == last) {
+                    return;
+                }
+                rec = mergeable();
+            }
+
+            const auto rfirst = std::make_reverse_iterator(last);
+            const auto rlast = std::make_reverse_iterator(first);
+            if (rec != nullptr && rec->kind == JournalRecord::erase_before &&
+                rec->pos == cursor) {
+                data.insert(data.end(), rfirst, rlast);
+                rec->pos -= last - first;
+                rec->count += last - first;
+                return;
+            }
+            add(JournalRecord::erase_before, cursor - (last - first), rfirst, rlast);
+        }
+
+        // [first, last) is about to be removed from just after the cursor
+        template <typename It>
+        void record_erase_after(const std::size_t cursor, It first, It last) {
+            if (replaying) {
+                return;
+            }
+            drop_redo();
+
+            JournalRecord* rec = mergeable();
+            if (rec != nullptr && rec->kind == JournalRecord::erase_after &&
+                rec->pos == cursor) {
+                data.insert(data.end(), first, last);
+                rec->count += last - first;
+                return;
+            }
+            add(JournalRecord::erase_after, cursor, first, last);
+        }
+
+       private:
+        // The last record, if the next edit may be merged into it
+        JournalRecord* mergeable() noexcept {
+            if (sealed || records.empty() || (depth > 0 && records.back().group != open_group)) {
+                return nullptr;
+            }
+            return &records.back();
+        }
+
+        template <typename It>
+        void add(
+            const typename JournalRecord::Kind kind, const std::size_t pos, It first, It last) {
+            const std::size_t offset = data.size();
+            data.insert(data.end(), first, last);
+            try {
+                const std::size_t group = depth > 0 ? open_group : next_group++;
+                records.push_back({kind, pos, offset, data.size() - offset, group});
+            } catch (...) {
+                data.erase(data.begin() + offset, data.end());
+                throw;
+            }
+            applied = records.size();
+            sealed = false;
+        }
+
+        // A new edit makes the undone records unreachable
+        void drop_redo() noexcept {
+            if (applied < records.size()) {
+                data.erase(data.begin() + records[applied].offset, data.end());
+                records.erase(records.begin() + applied, records.end());
+                sealed = true;
+            }
+        }
+    };
+
+    static constexpr auto make_line_index(const Allocator& alloc) {
+        if constexpr (is_text) {
+            const typename break_list::allocator_type list_alloc(alloc);
+            return LineIndex {break_list(list_alloc), break_list(list_alloc)};
+        } else {
+            return NoLineIndex {};
+        }
+    }
+
+    // Move the breaks at `first` and above from one half's list to the end
+    // of the other's. A break at i in one half sits at mirror - i in the
+    // other, which reverses the order. The tail is mapped and then reversed
+    // as whole blocks rather than one break at a time, so both passes
+    // vectorise.
+    static constexpr void transfer_breaks(
+        break_list& from, break_list& to, const std::size_t first, const std::size_t mirror) {
+        const auto split = std::ranges::lower_bound(from, first);
+        const std::size_t old_size = to.size();
+        to.resize(old_size + (from.end() - split));
+        std::transform(
+            split, from.end(), to.begin() + old_size,
+            [mirror](const std::size_t i) { return mirror - i; });
+        std::reverse(to.begin() + old_size, to.end());
+        from.erase(split, from.end());
+    }
+
+    // Record the line breaks in lhs from index `from` onwards
+    constexpr void index_lines(const std::size_t from) {
+        if constexpr (is_text) {
+            const auto find = twin_array_detail::kernels().find;
+            const char* end = lhs + lhs_size;
+            for (const char* it = find(lhs + from, lhs_size - from, '\n'); it != nullptr;
+                 it = find(it + 1, end - it - 1, '\n')) {
+                lines.lhs.push_back(it - lhs);
+            }
+        }
+    }
+
+    // Add n chars after the last element, leaving the cursor where it is. With
+    // rhs non-empty this shifts all of rhs, so callers should batch.
+    void append_back(const char* data, const std::size_t n)
+        requires(is_text)
+    {
+        if (capacity - lhs_size - rhs_size < n) {
+            resize(next_capacity(lhs_size + rhs_size + n));
+        }
+
+        if (rhs_size == 0) {
+            before_write_lhs(lhs_size, lhs_size + n);
+            std::memcpy(lhs + lhs_size, data, n);
+            lhs_size += n;
+            index_lines(lhs_size - n);
+            return;
+        }
+
+        // The new chars take rhs slots [0, n) and everything else moves up
+        before_write_rhs(0, rhs_size + n);
+        char* top = rhs_storage();
+        std::memmove(top - n, top, rhs_size);
+        std::memcpy(rhs_storage(0) - n, data, n);
+        rhs_size += n;
+
+        for (std::size_t& slot : lines.rhs) {
+            slot += n;
+        }
+        break_list added(lines.rhs.get_allocator());
+        const auto find = twin_array_detail::kernels().find;
+        for (const char* it = find(data, n, '\n'); it != nullptr;
+             it = find(it + 1, data + n - it - 1, '\n')) {
+            added.push_back(n - 1 - (it - data));
+        }
+        lines.rhs.insert(lines.rhs.begin(), added.rbegin(), added.rend());
+    }
+
+    // Call fn(data, len) on consecutive runs of the buffer in logical order
+    template <typename Fn>
+    void for_each_chunk(Fn&& fn) const
+        requires(is_text)
+    {
+        if (lhs_size > 0) {
+            fn(static_cast<const char*>(lhs), lhs_size);
+        }
+        if (rhs_size > 0) {
+            fn(rhs_storage(), rhs_size);
+        }
+    }
+
+#ifdef TWIN_ARRAY_POSIX
+    // writev() until every iovec has gone out, retrying short writes
+    static void write_fully(const int fd, iovec* iov, int count) {
+        while (count > 0) {
+            const ssize_t written = ::writev(fd, iov, count);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "writev");
+            }
+
+            std::size_t left = static_cast<std::size_t>(written);
+            while (count > 0 && left >= iov->iov_len) {
+                left -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+                iov->iov_len -= left;
+            }
+        }
+    }
+
+    // read() into the free space after lhs until end of file, growing as needed
+    void read_fully(const int fd)
+        requires(is_text)
+    {
+        const std::size_t old_size = lhs_size;
+        while (true) {
+            if (lhs_size + rhs_size == capacity) {
+                resize(next_capacity(capacity + 1));
+            }
+
+            const std::size_t space = capacity - lhs_size - rhs_size;
+            const ssize_t got = ::read(fd, lhs + lhs_size, space);
+            if (got < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "read");
+            }
+            if (got == 0) {
+                break;
+            }
+            lhs_size += static_cast<std::size_t>(got);
+        }
+        index_lines(old_size);
+    }
+#endif
+
+    // Index of the first c in [first, last), or npos
+    [[nodiscard]] constexpr std::size_t find_byte(
+        const char c, std::size_t first, const std::size_t last) const noexcept
+        requires(is_text)
+    {
+        const auto& kernels = twin_array_detail::kernels();
+
+        if (first < lhs_size) {
+            const std::size_t end = std::min(last, lhs_size);
+            if (const char* it = kernels.find(lhs + first, end - first, c)) {
+                return it - lhs;
+            }
+            first = lhs_size;
+        }
+
+        if (first >= last) {
+            return npos;
+        }
+
+        const std::size_t from = first - lhs_size;
+        const char* it = kernels.find(rhs_storage() + from, last - first, c);
+        return it == nullptr ? npos : lhs_size + (it - rhs_storage());
+    }
+
+    // Index of the last c in [0, last), or npos
+    [[nodiscard]] constexpr std::size_t rfind_byte(
+        const char c, const std::size_t last) const noexcept
+        requires(is_text)
+    {
+        const auto& kernels = twin_array_detail::kernels();
+
+        if (last > lhs_size) {
+            if (const char* it = kernels.rfind(rhs_storage(), last - lhs_size, c)) {
+                return lhs_size + (it - rhs_storage());
+            }
+        }
+
+        const char* it = kernels.rfind(lhs, std::min(last, lhs_size), c);
+        return it == nullptr ? npos : it - lhs;
+    }
+
+    // Whether needle occurs at index pos, which must leave room for all of it
+    [[nodiscard]] constexpr bool matches_at(
+        const std::size_t pos, const std::string_view needle) const noexcept
+        requires(is_text)
+    {
+        std::size_t matched = 0;
+        if (pos < lhs_size) {
+            matched = std::min(needle.size(), lhs_size - pos);
+            if (!equal_bytes(lhs + pos, needle.data(), matched)) {
+                return false;
+            }
+        }
+
+        const std::size_t offset = pos + matched - lhs_size;
+        const std::size_t rest = needle.size() - matched;
+        return rest == 0 || equal_bytes(rhs_storage() + offset, needle.data() + matched, rest);
+    }
+
+    // The code point starting at index pos, which may straddle the cursor
+    [[nodiscard]] constexpr twin_array_detail::Utf8Char decode_at(const std::size_t pos) const
+        noexcept
+        requires(is_text)
+    {
+        unsigned char bytes[4] = {};
+        const std::size_t avail = std::min<std::size_t>(4, lhs_size + rhs_size - pos);
+        for (std::size_t i = 0; i < avail; i++) {
+            bytes[i] = static_cast<unsigned char>(element(pos + i));
+            if (i > 0 && !twin_array_detail::is_continuation(element(pos + i))) {
+                return twin_array_detail::utf8_decode(bytes, i);
+            }
+        }
+        return twin_array_detail::utf8_decode(bytes, avail);
+    }
+
+    // Index of the code point that ends at pos
+    [[nodiscard]] constexpr std::size_t codepoint_start_before(const std::size_t pos) const
+        noexcept
+        requires(is_text)
+    {
+        std::size_t start = pos - 1;
+        while (start > 0 && pos - start < 4 && twin_array_detail::is_continuation(element(start))) {
+            start--;
+        }
+        // A stray continuation byte is a code point of its own
+        return decode_at(start).len == pos - start ? start : pos - 1;
+    }
+
+    // Index of the grapheme cluster that ends at pos
+    [[nodiscard]] constexpr std::size_t grapheme_start_before(const std::size_t pos) const
+        noexcept
+        requires(is_text)
+    {
+        std::size_t start = codepoint_start_before(pos);
+        char32_t cp = decode_at(start).cp;
+        while (start > 0) {
+            const std::size_t prev_start = codepoint_start_before(start);
+            const char32_t prev = decode_at(prev_start).cp;
+            if (!twin_array_detail::grapheme_joins(prev, cp)) {
+                break;
+            }
+
+            // Regional indicators pair up from the start of their run
+            if (twin_array_detail::is_regional_indicator(cp) &&
+                twin_array_detail::is_regional_indicator(prev)) {
+                std::size_t before = 0;
+                for (std::size_t i = start; i > 0; before++) {
+                    i = codepoint_start_before(i);
+                    if (!twin_array_detail::is_regional_indicator(decode_at(i).cp)) {
+                        break;
+                    }
+                }
+                if (before % 2 == 0) {
+                    break;
+                }
+            }
+            start = prev_start;
+            cp = prev;
+        }
+        return start;
+    }
+
+    // End of the grapheme cluster that starts at pos
+    [[nodiscard]] constexpr std::size_t grapheme_end(std::size_t pos) const noexcept
+        requires(is_text)
+    {
+        twin_array_detail::GraphemeBreaks breaks;
+        const std::size_t len = lhs_size + rhs_size;
+        auto ch = decode_at(pos);
+        breaks.starts_cluster(ch.cp);
+        for (pos += ch.len; pos < len; pos += ch.len) {
+            ch = decode_at(pos);
+            if (breaks.starts_cluster(ch.cp)) {
+                break;
+            }
+        }
+        return pos;
+    }
+
+    static constexpr bool equal_bytes(const char* a, const char* b, const std::size_t n) noexcept {
+        if (std::is_constant_evaluated()) {
+            return std::equal(a, a + n, b);
+        }
+        return std::memcmp(a, b, n) == 0;
+    }
+
+    // The array rhs lives at the back of: the whole block with the gap
+    // layout, its own array with the twin layout
+    [[nodiscard]] constexpr T* rhs_block() noexcept { return is_gap ? lhs : rhs; }
+    [[nodiscard]] constexpr const T* rhs_block() const noexcept { return is_gap ? lhs : rhs; }
+
+    // rhs is a stack whose top sits next to the cursor. Slot 0 is the last
+    // element of the buffer and slot rhs_size - 1 is the one right after the
+    // cursor, whichever layout is in use.
+    [[nodiscard]] constexpr T& rhs_slot(const std::size_t idx) noexcept {
+        return rhs_block()[capacity - 1 - idx];
+    }
+
+    [[nodiscard]] constexpr const T& rhs_slot(const std::size_t idx) const noexcept {
+        return rhs_block()[capacity - 1 - idx];
+    }
+
+    // Unchecked access by logical index, used by the iterators. Both halves
+    // are in logical order, so this is a single offset either way.
+    [[nodiscard]] constexpr T& element(const std::size_t idx) noexcept {
+        return idx < lhs_size ? lhs[idx] : rhs_storage()[idx - lhs_size];
+    }
+
+    [[nodiscard]] constexpr const T& element(const std::size_t idx) const noexcept {
+        return idx < lhs_size ? lhs[idx] : rhs_storage()[idx - lhs_size];
+    }
+
+    // First slot in memory of an rhs holding `count` elements. rhs ends at
+    // the back of its array, so this moves as rhs grows.
+    [[nodiscard]] constexpr T* rhs_storage(const std::size_t count) noexcept {
+        return rhs_block() + capacity - count;
+    }
+
+    [[nodiscard]] constexpr const T* rhs_storage(const std::size_t count) const noexcept {
+        return rhs_block() + capacity - count;
+    }
+
+    [[nodiscard]] constexpr T* rhs_storage() noexcept { return rhs_storage(rhs_size); }
+    [[nodiscard]] constexpr const T* rhs_storage() const noexcept { return rhs_storage(rhs_size); }
+
+    // Trivially copyable elements held by the default allocator live in
+    // malloc'd storage so that resize() can use realloc
+    static constexpr bool reallocatable = std::is_same_v<Allocator, std::allocator<T>> &&
+                                          std::is_trivially_copyable_v<T> &&
+                                          alignof(T) <= alignof(std::max_align_t);
+
+    static constexpr std::size_t default_capacity = InlineCapacity > 0 ? InlineCapacity : 32;
+
+    // Initial capacity for `count` elements. Leaves some room to grow unless
+    // they fit inline.
+    static constexpr std::size_t with_slack(const std::size_t count) noexcept {
+        return InlineCapacity > 0 && count <= InlineCapacity ? InlineCapacity : count + 8;
+    }
+
+    static constexpr bool pocca = alloc_traits::propagate_on_container_copy_assignment::value;
+    static constexpr bool pocma = alloc_traits::propagate_on_container_move_assignment::value;
+
+    [[nodiscard]] constexpr T* allocate(const std::size_t n) {
+        if constexpr (reallocatable) {
+            if (!std::is_constant_evaluated()) {
+                void* ptr = std::malloc(std::max<std::size_t>(n, 1) * sizeof(T));
+                if (ptr == nullptr) {
+                    throw std::bad_alloc();
+                }
+                return static_cast<T*>(ptr);
+            }
+        }
+        return alloc_traits::allocate(alloc, n);
+    }
+
+    constexpr void deallocate(T* ptr, const std::size_t n) noexcept { deallocate(alloc, ptr, n); }
+
+    static constexpr void deallocate(Allocator& alloc, T* ptr, const std::size_t n) noexcept {
+        if (ptr == nullptr) {
+            return;
+        }
+
+        if constexpr (reallocatable) {
+            if (!std::is_constant_evaluated()) {
+                std::free(ptr);
+                return;
+            }
+        }
+        alloc_traits::deallocate(alloc, ptr, n);
+    }
+
+    template <typename... Args>
+    constexpr void construct(T* ptr, Args&&... args) {
+        alloc_traits::construct(alloc, ptr, std::forward<Args>(args)...);
+    }
+
+    constexpr void destroy(T* ptr) noexcept { alloc_traits::destroy(alloc, ptr); }
+
+    constexpr void destroy(T* first, T* last) noexcept {
+        for (; first != last; ++first) {
+            destroy(first);
+        }
+    }
+
+    // Copy-construct [first, last) into raw storage starting at out. Returns
+    // one past the last constructed slot, or destroys the partial copy and
+    // rethrows. Contiguous runs of trivially copyable T are block copied,
+    // except in constant evaluation, where every slot has to be constructed.
+    template <typename InputIt, typename Sentinel>
+    constexpr T* construct_copies(InputIt first, Sentinel last, T* out) {
+        if constexpr (
+            std::is_trivially_copyable_v<T> && std::contiguous_iterator<InputIt> &&
+            std::is_same_v<std::iter_value_t<InputIt>, T>) {
+            if (!std::is_constant_evaluated()) {
+                return std::ranges::copy(first, last, out).out;
+            }
+        }
+
+        T* cur = out;
+        try {
+            for (; first != last; ++first, ++cur) {
+                construct(cur, *first);
+            }
+        } catch (...) {
+            destroy(out, cur);
+            throw;
+        }
+        return cur;
+    }
+
+    // Copy both halves of other into this array's empty storage, which must
+    // have room for them
+    constexpr void copy_elements_from(const TwinArray& other) {
+        construct_copies(other.lhs, other.lhs + other.lhs_size, lhs);
+        lhs_size = other.lhs_size;
+
+        construct_copies(
+            other.rhs_storage(), other.rhs_storage() + other.rhs_size,
+            rhs_storage(other.rhs_size));
+        rhs_size = other.rhs_size;
+
+        if constexpr (is_text) {
+            lines.lhs = other.lines.lhs;
+            lines.rhs = other.lines.rhs;
+        }
+    }
+
+    // Move both halves of other into this array's empty storage and leave
+    // other empty. Trivially copyable elements are block copied outside
+    // constant evaluation.
+    constexpr void relocate_elements_from(TwinArray& other) {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (!std::is_constant_evaluated()) {
+                std::copy(other.lhs, other.lhs + other.lhs_size, lhs);
+                std::copy(
+                    other.rhs_storage(), other.rhs_storage() + other.rhs_size,
+                    rhs_storage(other.rhs_size));
+                std::swap(lhs_size, other.lhs_size);
+                std::swap(rhs_size, other.rhs_size);
+                std::swap(lines, other.lines);
+                return;
+            }
+        }
+
+        if constexpr (std::is_nothrow_move_constructible_v<T>) {
+            for (std::size_t i = 0; i < other.lhs_size; i++) {
+                construct(lhs + i, std::move(other.lhs[i]));
+            }
+            T* src = other.rhs_storage();
+            T* dest = rhs_storage(other.rhs_size);
+            for (std::size_t i = 0; i < other.rhs_size; i++) {
+                construct(dest + i, std::move(src[i]));
+            }
+
+            lhs_size = other.lhs_size;
+            rhs_size = other.rhs_size;
+            std::swap(lines, other.lines);
+            other.clear_elements();
+        } else {
+            copy_elements_from(other);
+            other.clear_elements();
+        }
+    }
+
+    // Grow or shrink the storage in place with realloc. For large blocks the
+    // C library can remap pages instead of copying them.
+    void reallocate(const std::size_t new_cap)
+        requires(reallocatable)
+    {
+        if constexpr (is_gap) {
+            realloc_block(lhs, new_cap, rhs_size);
+        } else {
+            // free() does not need the block size, so if the second realloc
+            // fails the first one can stay as it is
+            realloc_block(lhs, new_cap, 0);
+            realloc_block(rhs, new_cap, rhs_size);
+        }
+
+        capacity = new_cap;
+    }
+
+    // Resize one block of the storage, keeping its last `tail` elements at
+    // the back. Shrinking never fails: if realloc() refuses, the old block
+    // still has room for everything.
+    void realloc_block(T*& block, const std::size_t new_cap, const std::size_t tail)
+        requires(reallocatable)
+    {
+        const std::size_t bytes = std::max<std::size_t>(new_cap, 1) * sizeof(T);
+        if (new_cap < capacity) {
+            std::memmove(block + new_cap - tail, block + capacity - tail, tail * sizeof(T));
+            if (T* shrunk = static_cast<T*>(std::realloc(block, bytes))) {
+                block = shrunk;
+            }
+            return;
+        }
+
+        T* grown = static_cast<T*>(std::realloc(block, bytes));
+        if (grown == nullptr) {
+            throw std::bad_alloc();
+        }
+        std::memmove(grown + new_cap - tail, grown + capacity - tail, tail * sizeof(T));
+        block = grown;
+    }
+
+    // Capacity for the next growth step, with room for at least `required`
+    [[nodiscard]] constexpr std::size_t next_capacity(const std::size_t required) const noexcept {
+        const double scaled = static_cast<double>(capacity) * growth.factor;
+        std::size_t grown = scaled >= static_cast<double>(std::numeric_limits<std::size_t>::max())
+                                ? std::numeric_limits<std::size_t>::max()
+                                : static_cast<std::size_t>(scaled);
+
+        if (grown - capacity > growth.max_step) {
+            grown = capacity + growth.max_step;
+        }
+        return std::max(grown, required);
+    }
+
+    // Undo one journal record. The cursor ends up where the edit was made.
+    void revert(const JournalRecord& rec) {
+        const auto run = std::span<const T>(journal->data.data() + rec.offset, rec.count);
+        move_to(rec.pos);
+        switch (rec.kind) {
+            case JournalRecord::insert:
+                erase_after(rec.count);
+                break;
+            case JournalRecord::erase_before:
+                insert(run | std::views::reverse);
+                break;
+            case JournalRecord::erase_after:
+                insert(run);
+                move_to(rec.pos);
+                break;
+        }
+    }
+
+    void reapply(const JournalRecord& rec) {
+        const auto run = std::span<const T>(journal->data.data() + rec.offset, rec.count);
+        switch (rec.kind) {
+            case JournalRecord::insert:
+                move_to(rec.pos);
+                insert(run);
+                break;
+            case JournalRecord::erase_before:
+                move_to(rec.pos + rec.count);
+                erase_before(rec.count);
+                break;
+            case JournalRecord::erase_after:
+                move_to(rec.pos);
+                erase_after(rec.count);
+                break;
+        }
+    }
+
+    // emplace() once there is room
+    template <typename... Args>
+    constexpr T& emplace_unchecked(Args&&... args) {
+        before_write_lhs(lhs_size, lhs_size + 1);
+        construct(lhs + lhs_size, std::forward<Args>(args)...);
+        if constexpr (is_text) {
+            if (lhs[lhs_size] == '\n') {
+                lines.lhs.push_back(lhs_size);
+            }
+        }
+        lhs_size++;
+        journal_edit([&](auto& j) {
+            j.record_insert(lhs_size - 1, lhs + lhs_size - 1, lhs + lhs_size);
+        });
+        bump_stat([](TwinStats& stats) { stats.pushes++; });
+        return lhs[lhs_size - 1];
+    }
+
+    // Hand an edit to the journal, if one is recording. Histories keep copies
+    // of the elements, so move-only types never record anything.
+    template <typename Fn>
+    constexpr void journal_edit([[maybe_unused]] Fn&& fn) {
+        if constexpr (std::is_copy_constructible_v<T>) {
+            if (journal) {
+                fn(*journal);
+            }
+        }
+    }
+
+    // Update the instrumentation counters, see TwinStats. Compiles to nothing
+    // unless TWIN_ARRAY_STATS is defined, and does nothing in constant evaluation.
+    template <typename Fn>
+    constexpr void bump_stat([[maybe_unused]] Fn&& fn) const noexcept {
+#ifdef TWIN_ARRAY_STATS
+        if (!std::is_constant_evaluated()) {
+            fn(counters);
+        }
+#endif
+    }
+
+    // Called before the capacity changes; stats() covers the current one
+    constexpr void note_peak_capacity() const noexcept {
+        bump_stat([&](TwinStats& stats) {
+            stats.peak_capacity = std::max(stats.peak_capacity, capacity);
+        });
+    }
+
+    constexpr void clear_elements() noexcept {
+        destroy(lhs, lhs + lhs_size);
+        destroy(rhs_storage(), rhs_storage() + rhs_size);
+        lhs_size = 0;
+        rhs_size = 0;
+        if constexpr (is_text) {
+            lines.lhs.clear();
+            lines.rhs.clear();
+        }
+    }
+
+    constexpr void swap_storage(TwinArray& other) noexcept {
+        note_peak_capacity();
+        if constexpr (InlineCapacity > 0) {
+            if (is_inline() || other.is_inline()) {
+                // Inline elements can't change hands by pointer, so they go
+                // through an empty third array
+                TwinArray tmp(InlineCapacity, alloc);
+                tmp.take_storage(*this);
+                take_storage(other);
+                other.take_storage(tmp);
+                return;
+            }
+        }
+
+        std::swap(lhs, other.lhs);
+        std::swap(rhs, other.rhs);
+        std::swap(lhs_size, other.lhs_size);
+        std::swap(rhs_size, other.rhs_size);
+        std::swap(capacity, other.capacity);
+        std::swap(lines, other.lines);
+        std::swap(sharing, other.sharing);
+    }
+
+    // Move other's elements and storage into this array, which must be empty
+    // and hold no heap storage. other is left empty on its inline storage.
+    constexpr void take_storage(TwinArray& other) noexcept {
+        note_peak_capacity();
+        if (other.is_inline()) {
+            relocate_elements_from(other);
+            return;
+        }
+
+        lhs = other.lhs;
+        rhs = other.rhs;
+        capacity = other.capacity;
+        std::swap(lhs_size, other.lhs_size);
+        std::swap(rhs_size, other.rhs_size);
+        std::swap(lines, other.lines);
+        sharing = std::move(other.sharing);
+        other.use_inline_storage();
+    }
+
+    // Whether range may point into this array's storage. Only contiguous
+    // ranges of T are checked. Constant evaluation can't order pointers into
+    // different blocks, so there each slot is compared in turn.
+    template <typename R>
+    [[nodiscard]] constexpr bool may_alias(R& range) const noexcept {
+        if constexpr (
+            std::ranges::contiguous_range<R> &&
+            std::is_same_v<std::ranges::range_value_t<R>, T>) {
+            const T* ptr = std::to_address(std::ranges::data(range));
+            if (std::is_constant_evaluated()) {
+                for (std::size_t i = 0; i < capacity; i++) {
+                    if (ptr == lhs + i || (!is_gap && ptr == rhs + i)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            const auto within = [&](const T* block) {
+                return block != nullptr && !std::less<>()(ptr, block) &&
+                       std::less<>()(ptr, block + capacity);
+            };
+            return within(lhs) || (!is_gap && within(rhs));
+        } else {
+            return false;
+        }
+    }
+
+    [[nodiscard]] constexpr bool is_inline() const noexcept {
+        if constexpr (InlineCapacity > 0) {
+            return lhs == inline_storage.data();
+        } else {
+            return false;
+        }
+    }
+
+    // Point at the inline storage, or at nothing without any
+    constexpr void use_inline_storage() noexcept {
+        if constexpr (InlineCapacity > 0) {
+            lhs = inline_storage.data();
+            rhs = is_gap ? nullptr : lhs + InlineCapacity;
+        } else {
+            lhs = nullptr;
+            rhs = nullptr;
+        }
+        capacity = InlineCapacity;
+    }
+
+    // Destroy the live elements and hand the storage back
+    constexpr void release() noexcept {
+        destroy(lhs, lhs + lhs_size);
+        destroy(rhs_storage(), rhs_storage() + rhs_size);
+        if (is_inline()) {
+            return;
+        }
+        if (sharing) {
+            // Freed by the shared block once no snapshot needs it
+            sharing.reset();
+            return;
+        }
+        deallocate(lhs, capacity);
+        deallocate(rhs, capacity);
+    }
+
+    // Whether no snapshot still uses the storage. Once that is the case the
+    // shared block hands ownership back.
+    constexpr bool storage_exclusive() noexcept {
+        if (!sharing) {
+            return true;
+        }
+        if (sharing->block.use_count() > 1) {
+            return false;
+        }
+        std::get_deleter<BlockDeleter>(sharing->block)->armed = false;
+        sharing.reset();
+        return true;
+    }
+
+    // Give this buffer storage of its own again, see snapshot(). Element
+    // access calls this every time, so while nothing is shared it costs one
+    // branch and the copy stays out of line.
+    constexpr void unshare() {
+        if (sharing) [[unlikely]] {
+            detach();
+        }
+    }
+
+    constexpr void detach() {
+        if (!storage_exclusive()) {
+            TwinArray tmp(capacity, alloc);
+            tmp.relocate_elements_from(*this);
+            swap_storage(tmp);
+        }
+    }
+
+    // Let snapshots copy aside what they still need from lhs memory
+    // [first, last) (the whole block with the gap layout) before it is
+    // overwritten
+    constexpr void before_write_lhs(const std::size_t first, const std::size_t last) {
+        if (sharing && first < last &&
+            (first < sharing->frozen_lhs || (is_gap && last > capacity - sharing->frozen_rhs))) {
+            preserve_for_snapshots(false, first, last);
+        }
+    }
+
+    // Same for rhs slots [first, last)
+    constexpr void before_write_rhs(const std::size_t first, const std::size_t last) {
+        if constexpr (is_gap) {
+            before_write_lhs(capacity - last, capacity - first);
+        } else if (sharing && first < last && first < sharing->frozen_rhs) {
+            preserve_for_snapshots(true, capacity - last, capacity - first);
+        }
+    }
+
+    void preserve_for_snapshots(
+        const bool in_rhs, const std::size_t first, const std::size_t last) {
+        if constexpr (snapshottable) {
+            if (storage_exclusive()) {
+                return;
+            }
+
+            for_each_view([&](twin_array_detail::FrozenView<T>& view) {
+                if (in_rhs) {
+                    view.preserve_rhs(first, last);
+                } else {
+                    view.preserve_lhs(first, last);
+                }
+            });
+        }
+    }
+
+    // Call fn on every view still in use, dropping the expired ones and
+    // narrowing the frozen extents to the rest
+    template <typename Fn>
+    void for_each_view(Fn&& fn) {
+        auto& views = sharing->views;
+        sharing->frozen_lhs = 0;
+        sharing->frozen_rhs = 0;
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < views.size(); i++) {
+            const auto view = views[i].lock();
+            if (!view) {
+                continue;
+            }
+            fn(*view);
+            sharing->frozen_lhs = std::max(sharing->frozen_lhs, view->lhs_size);
+            sharing->frozen_rhs = std::max(sharing->frozen_rhs, view->rhs_size);
+            if (kept != i) {
+                views[kept] = std::move(views[i]);
+            }
+            kept++;
+        }
+        views.resize(kept);
+    }
+
+    [[no_unique_address]] Allocator alloc;
+
+    // With TwinLayout::gap, lhs owns the whole block and rhs stays null.
+    // Both halves are stored in logical order: lhs from the front of its
+    // array and rhs against the back of its own (or of the shared block).
+    // Only those elements are live objects, the rest is raw storage.
+    T* lhs;
+    T* rhs;
+    std::size_t lhs_size;
+    std::size_t rhs_size;
+    std::size_t capacity;
+    TwinGrowth growth;
+    [[no_unique_address]] std::conditional_t<is_text, LineIndex, NoLineIndex> lines;
+    [[no_unique_address]] std::conditional_t<
+        (InlineCapacity > 0), InlineStorage<(is_gap ? 1 : 2) * InlineCapacity>, NoInlineStorage>
+        inline_storage;
+    twin_array_detail::Owned<Journal> journal;
+    twin_array_detail::Owned<Sharing> sharing;
+#ifdef TWIN_ARRAY_STATS
+    mutable TwinStats counters;
+#endif
+};
+
+// The contents of a TwinArray at the time of its snapshot() call. Copies
+// share one view, and every member can be used from any thread.
+template <typename T>
+class TwinSnapshot {
+   public:
+    [[nodiscard]] std::size_t size() const noexcept { return view->lhs_size + view->rhs_size; }
+    [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+    // Throws std::out_of_range
+    [[nodiscard]] T at(const std::size_t idx) const {
+        if (idx >= size()) {
+            throw std::out_of_range("index out of range");
+        }
+        return view->element(idx);
+    }
+
+    // Call fn(data, len) on consecutive runs of the contents in logical order
+    template <typename Fn>
+    void for_each_chunk(Fn&& fn) const {
+        view->for_each_chunk(fn);
+    }
+
+    [[nodiscard]] std::string to_str() const
+        requires(std::is_same_v<T, char>)
+    {
+        std::string ret;
+        ret.reserve(size());
+        for_each_chunk([&](const char* data, const std::size_t len) { ret.append(data, len); });
+        return ret;
+    }
+
+   private:
+    template <typename, TwinLayout, typename, std::size_t>
+    friend class TwinArray;
+
+    template <typename, TwinLayout, typename>
+    friend class ConcurrentTwinArray;
+
+    explicit TwinSnapshot(std::shared_ptr<const twin_array_detail::FrozenView<T>> view)
+        : view(std::move(view)) {}
+
+    std::shared_ptr<const twin_array_detail::FrozenView<T>> view;
+};
+
+// Shares a TwinArray between one writer thread and any number of readers.
+// The writer edits writer() and calls publish(), or wraps each edit in
+// edit(). Readers call read() from any thread and get the contents as of
+// the last publish, never a half-applied edit. Versions are snapshots, so
+// publishing costs no copy. The latest version is an atomic shared_ptr and
+// a version is read without locks (see FrozenView), so readers never wait
+// for the writer or for each other.
+template <typename T, TwinLayout Layout = TwinLayout::twin, typename Allocator = std::allocator<T>>
+class ConcurrentTwinArray {
+   public:
+    using buffer_type = TwinArray<T, Layout, Allocator>;
+
+    ConcurrentTwinArray() { publish(); }
+    explicit ConcurrentTwinArray(buffer_type buf) : buf(std::move(buf)) { publish(); }
+
+    // Writer thread only
+    [[nodiscard]] buffer_type& writer() noexcept { return buf; }
+
+    void publish() {
+        published.store(buf.snapshot().view);
+    }
+
+    // Apply fn(writer()) and publish the result
+    template <typename Fn>
+    void edit(Fn&& fn) {
+        std::forward<Fn>(fn)(buf);
+        publish();
+    }
+
+    // Any thread
+    [[nodiscard]] TwinSnapshot<T> read() const { return TwinSnapshot<T>(published.load()); }
+
+   private:
+    buffer_type buf;
+    std::atomic<std::shared_ptr<const twin_array_detail::FrozenView<T>>> published;
+};
+
+// A set of cursors over a TwinArray for multi-cursor editing. Positions are
+// logical indices, kept sorted and distinct. Each edit visits them left to
+// right, so the buffer's own cursor sweeps across the text once instead of
+// travelling back and forth for every cursor, and afterwards every position
+// is where that cursor's edit left it. An edit is a single undo step and
+// leaves the buffer's cursor at the last position.
+class TwinCursors {
+   public:
+    TwinCursors() = default;
+    TwinCursors(std::initializer_list<std::size_t> list) : cursors(list) { normalise(); }
+
+    void add(const std::size_t pos) {
+        const auto it = std::ranges::lower_bound(cursors, pos);
+        if (it == cursors.end() || *it != pos) {
+            cursors.insert(it, pos);
+        }
+    }
+
+    void remove(const std::size_t pos) {
+        const auto it = std::ranges::lower_bound(cursors, pos);
+        if (it != cursors.end() && *it == pos) {
+            cursors.erase(it);
+        }
+    }
+
+    void clear() noexcept { cursors.clear(); }
+
+    [[nodiscard]] std::span<const std::size_t> positions() const noexcept { return cursors; }
+    [[nodiscard]] std::size_t size() const noexcept { return cursors.size(); }
+    [[nodiscard]] bool empty() const noexcept { return cursors.empty(); }
+
+    // Shift every cursor by offset, stopping at either end of buf. Cursors
+    // that land on the same position merge.
+    template <typename T, TwinLayout Layout, typename Allocator, std::size_t InlineCapacity>
+    void move_by(const TwinArray<T, Layout, Allocator, InlineCapacity>& buf,
+                 const std::ptrdiff_t offset) {
+        const std::ptrdiff_t end = buf.size();
+        for (auto& pos : cursors) {
+            pos = std::clamp(static_cast<std::ptrdiff_t>(pos) + offset, std::ptrdiff_t{0}, end);
+        }
+        normalise();
+    }
+
+    // Insert range at every cursor, leaving each cursor after its copy.
+    // Throws std::out_of_range, before editing, if a cursor is past the end.
+    template <typename T, TwinLayout Layout, typename Allocator, std::size_t InlineCapacity,
+              std::ranges::forward_range R>
+        requires std::convertible_to<std::ranges::range_reference_t<R>, const T&>
+    void insert(TwinArray<T, Layout, Allocator, InlineCapacity>& buf, R&& range) {
+        check(buf);
+        const auto count = static_cast<std::size_t>(std::ranges::distance(range));
+        if (count == 0 || cursors.empty()) {
+            return;
+        }
+        if (buf.may_alias(range)) {
+            // The edits below move and grow the storage the range points into
+            insert(buf, std::vector<T, Allocator>(
+                std::ranges::begin(range), std::ranges::end(range), buf.get_allocator()));
+            return;
+        }
+        buf.reserve(static_cast<std::size_t>(buf.size()) + count * cursors.size());
+
+        Transaction transaction(buf);
+        std::size_t shift = 0;
+        for (auto& pos : cursors) {
+            buf.move_to(pos + shift);
+            buf.insert(range);
+            shift += count;
+            pos += shift;
+        }
+    }
+
+    template <typename T, TwinLayout Layout, typename Allocator, std::size_t InlineCapacity>
+    void insert(TwinArray<T, Layout, Allocator, InlineCapacity>& buf,
+                std::initializer_list<T> lst) {
+        insert(buf, std::span<const T>(lst.begin(), lst.size()));
+    }
+
+    template <typename T, TwinLayout Layout, typename Allocator, std::size_t InlineCapacity>
+    void push(TwinArray<T, Layout, Allocator, InlineCapacity>& buf, const T& val) {
+        insert(buf, std::span<const T>(&val, 1));
+    }
+
+    // Remove up to count elements before every cursor, like backspace. A
+    // deletion stops at the cursor before it, and cursors that meet merge.
+    // Returns how many elements were removed in total.
+    template <typename T, TwinLayout Layout, typename Allocator, std::size_t InlineCapacity>
+    std::size_t erase_before(TwinArray<T, Layout, Allocator, InlineCapacity>& buf,
+                             const std::size_t count) {
+        check(buf);
+        Transaction transaction(buf);
+        std::size_t removed = 0;
+        std::size_t prev = 0;
+        for (auto& pos : cursors) {
+            const std::size_t at = pos - removed;
+            buf.move_to(at);
+            removed += buf.erase_before(std::min(count, at - prev));
+            pos = prev = pos - removed;
+        }
+        normalise();
+        return removed;
+    }
+
+    // Remove up to count elements after every cursor, like forward delete. A
+    // deletion stops at the next cursor, and cursors that meet merge. Returns
+    // how many elements were removed in total.
+    template <typename T, TwinLayout Layout, typename Allocator, std::size_t InlineCapacity>
+    std::size_t erase_after(TwinArray<T, Layout, Allocator, InlineCapacity>& buf,
+                            const std::size_t count) {
+        check(buf);
+        Transaction transaction(buf);
+        const std::size_t end = buf.size();
+        std::size_t removed = 0;
+        for (std::size_t i = 0; i < cursors.size(); i++) {
+            const std::size_t next = i + 1 < cursors.size() ? cursors[i + 1] : end;
+            const std::size_t at = cursors[i] - removed;
+            buf.move_to(at);
+            removed += buf.erase_after(std::min(count, next - cursors[i]));
+            cursors[i] = at;
+        }
+        normalise();
+        return removed;
+    }
+
+   private:
+    // Groups an edit into one undo step, even if it throws halfway
+    template <typename Buffer>
+    struct Transaction {
+        explicit Transaction(Buffer& buf) : buf(buf) { buf.begin_transaction(); }
+        ~Transaction() { buf.end_transaction(); }
+        Buffer& buf;
+    };
+
+    template <typename Buffer>
+    void check(const Buffer& buf) const {
+        if (!cursors.empty() && cursors.back() > static_cast<std::size_t>(buf.size())) {
+            throw std::out_of_range("cursor out of range");
+        }
+    }
+
+    void normalise() {
+        std::ranges::sort(cursors);
+        const auto dupes = std::ranges::unique(cursors);
+        cursors.erase(dupes.begin(), dupes.end());
+    }
+
+    std::vector<std::size_t> cursors;
+};
+
+#ifdef TWIN_ARRAY_POSIX
+// Loads a file descriptor into a TwinArray<char> one chunk per step(), so an
+// event loop can show and edit the text while the rest is still arriving.
+// Chunks are read straight into the free space after lhs whenever the cursor
+// is at the end. Otherwise they are held back and appended in batches at
+// least as large as rhs, which keeps the total cost of appending linear.
+// The descriptor is not owned and may be non-blocking.
+class TwinLoader {
+   public:
+    explicit TwinLoader(const int fd, const std::size_t chunk_size = 64 * 1024)
+        : fd(fd), chunk_size(chunk_size == 0 ? 1 : chunk_size) {
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            expected = static_cast<std::size_t>(st.st_size);
+        }
+    }
+
+    // Read at most one chunk into buf. Returns false once the input has been
+    // fully loaded. Pass the same buffer every time. Throws std::system_error
+    // if the read fails.
+    template <TwinLayout Layout, typename Allocator, std::size_t InlineCapacity>
+    bool step(TwinArray<char, Layout, Allocator, InlineCapacity>& buf) {
+        if (finished) {
+            return false;
+        }
+        if (!pending.empty() && buf.rhs_size == 0) {
+            flush(buf);
+        }
+
+        if (pending.empty() && buf.rhs_size == 0) {
+            if (buf.capacity - buf.lhs_size < chunk_size) {
+                buf.resize(buf.next_capacity(buf.lhs_size + chunk_size));
+            }
+            buf.before_write_lhs(buf.lhs_size, buf.lhs_size + chunk_size);
+
+            const ssize_t got = read_chunk(buf.lhs + buf.lhs_size);
+            if (got > 0) {
+                buf.lhs_size += got;
+                buf.index_lines(buf.lhs_size - got);
+                appended += got;
+            }
+            return !finished;
+        }
+
+        const std::size_t old_size = pending.size();
+        pending.resize(old_size + chunk_size);
+        const ssize_t got = read_chunk(pending.data() + old_size);
+        pending.resize(old_size + std::max<ssize_t>(got, 0));
+
+        if (got <= 0 || pending.size() >= buf.rhs_size) {
+            flush(buf);
+        }
+        return !finished;
+    }
+
+    // Bytes appended to the buffer so far
+    [[nodiscard]] std::size_t loaded() const noexcept { return appended; }
+
+    // Size of the input if it is a regular file, 0 if unknown
+    [[nodiscard]] std::size_t total() const noexcept { return expected; }
+
+    [[nodiscard]] bool done() const noexcept { return finished; }
+
+   private:
+    // Returns the byte count, 0 at end of file or -1 if a non-blocking
+    // descriptor has nothing ready
+    ssize_t read_chunk(char* out) {
+        while (true) {
+            const ssize_t got = ::read(fd, out, chunk_size);
+            if (got >= 0) {
+                finished = got == 0;
+                return got;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return -1;
+            }
+            if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "read");
+            }
+        }
+    }
+
+    template <TwinLayout Layout, typename Allocator, std::size_t InlineCapacity>
+    void flush(TwinArray<char, Layout, Allocator, InlineCapacity>& buf) {
+        if (pending.empty()) {
+            return;
+        }
+        buf.append_back(pending.data(), pending.size());
+        appended += pending.size();
+        pending.clear();
+    }
+
+    int fd;
+    std::size_t chunk_size;
+    std::size_t expected = 0;
+    std::size_t appended = 0;
+    bool finished = false;
+    std::string pending;
+};
+#endif
+
+// Keeps up to N elements without touching the heap. Defaults to the gap
+// layout, which needs half the inline space of `twin`.
+template <typename T, std::size_t N, TwinLayout Layout = TwinLayout::gap>
+using SmallTwinArray = TwinArray<T, Layout, std::allocator<T>, N>;
+
+namespace pmr {
+    template <typename T, TwinLayout Layout = TwinLayout::twin>
+    using TwinArray = ::TwinArray<T, Layout, std::pmr::polymorphic_allocator<T>>;
+}  // namespace pmr
 
 #endif  // TWIN_ARRAY_H